@@ -77,6 +77,7 @@
                         "." RTMIDI_TOSTRING(RTMIDI_VERSION_PATCH)
 #endif
 
+#include <atomic>
 #include <exception>
 #include <iostream>
 #include <string>
@@ -164,6 +165,7 @@ class RTMIDI_DLL_PUBLIC RtMidi
     WEB_MIDI_API,   /*!< W3C Web MIDI API. */
     WINDOWS_UWP,    /*!< The Microsoft Universal Windows Platform MIDI API. */
     ANDROID_AMIDI,  /*!< Native Android MIDI API. */
+    LINUX_ALSA_RAW, /*!< Direct ALSA rawmidi device access (input only). */
     NUM_APIS        /*!< Number of values in this enum. */
   };
 
@@ -383,6 +385,23 @@ class RTMIDI_DLL_PUBLIC RtMidiIn : public RtMidi
   */
   void ignoreTypes( bool midiSysex = true, bool midiTime = true, bool midiSense = true );
 
+  //! Restrict input to an explicit set of MIDI status bytes.
+  /*!
+    Only messages whose status byte appears in \e statusBytes are
+    queued or passed to the callback.  Channel voice status bytes
+    (0x80-0xEF) include the channel, so a filter can select individual
+    channels as well as message types.  An empty vector blocks all
+    input.  The ignoreTypes() flags are still applied.
+
+    With the Linux ALSA API the corresponding sequencer event types are
+    also installed as a client event filter, so messages of other types
+    are dropped by the kernel and never wake the input thread.
+  */
+  void setStatusFilter( const std::vector<unsigned char> &statusBytes );
+
+  //! Remove a filter installed with setStatusFilter().
+  void clearStatusFilter( void );
+
   //! Fill the user-provided vector with the data bytes for the next available MIDI message in the input queue and return the event delta-time in seconds.
   /*!
     This function returns immediately whether a new message is
@@ -511,6 +530,26 @@ class RTMIDI_DLL_PUBLIC RtMidiOut : public RtMidi
   */
   void sendMessage( const unsigned char *message, size_t size );
 
+  //! Immediately send a batch of messages out an open MIDI output port.
+  /*!
+      Messages are sent in order.  APIs that buffer output (ALSA)
+      encode the whole batch and flush it once, which is much cheaper
+      than calling sendMessage() per message for large state dumps.
+  */
+  void sendMessages( const std::vector< std::vector<unsigned char> > &messages );
+
+  //! Send a message \e delay seconds from now.
+  /*!
+      On ALSA the message is placed on a sequencer queue and delivered
+      by the kernel at the requested time, independently of the calling
+      thread.  APIs without a scheduler send the message immediately.
+
+      \param message A pointer to the MIDI message as raw bytes
+      \param size    Length of the MIDI message in bytes
+      \param delay   Delivery time relative to now, in seconds
+  */
+  void scheduleMessage( const unsigned char *message, size_t size, double delay );
+
   //! Set an error callback function to be invoked when an error has occurred.
   /*!
     The callback function will be called whenever an error has occurred. It is best
@@ -579,6 +618,8 @@ class RTMIDI_DLL_PUBLIC MidiInApi : public MidiApi
   void setCallback( RtMidiIn::RtMidiCallback callback, void *userData );
   void cancelCallback( void );
   virtual void ignoreTypes( bool midiSysex, bool midiTime, bool midiSense );
+  virtual void setStatusFilter( const std::vector<unsigned char> &statusBytes );
+  virtual void clearStatusFilter( void );
   virtual double getMessage( std::vector<unsigned char> *message );
   virtual void setBufferSize( unsigned int size, unsigned int count );
 
@@ -624,11 +665,21 @@ class RTMIDI_DLL_PUBLIC MidiInApi : public MidiApi
     bool continueSysex;
     unsigned int bufferSize;
     unsigned int bufferCount;
+    // Read by the input thread while the application may replace them, so
+    // each 64-status word is published whole (see setStatusFilter)
+    std::atomic<bool> filterStatus;
+    std::atomic<unsigned long long> statusFilter[4];
 
     // Default constructor.
     RtMidiInData()
       : ignoreFlags(7), doInput(false), firstMessage(true), apiData(0), usingCallback(false),
-        userCallback(0), userData(0), continueSysex(false), bufferSize(1024), bufferCount(4) {}
+        userCallback(0), userData(0), continueSysex(false), bufferSize(1024), bufferCount(4),
+        filterStatus(false), statusFilter() {}
+
+    // Returns true if a message with this status byte passes the status filter.
+    bool acceptsStatus( unsigned char status ) const
+      { return !filterStatus.load( std::memory_order_acquire ) ||
+               ( ( statusFilter[status >> 6].load( std::memory_order_relaxed ) >> ( status & 63 ) ) & 1 ); }
   };
 
  protected:
@@ -642,6 +693,8 @@ class RTMIDI_DLL_PUBLIC MidiOutApi : public MidiApi
   MidiOutApi( void );
   virtual ~MidiOutApi( void );
   virtual void sendMessage( const unsigned char *message, size_t size ) = 0;
+  virtual void sendMessages( const std::vector< std::vector<unsigned char> > &messages );
+  virtual void scheduleMessage( const unsigned char *message, size_t size, double delay );
 };
 
 // **************************************************************** //
@@ -660,6 +713,8 @@ inline void RtMidiIn :: cancelCallback( void ) { static_cast<MidiInApi *>(rtapi_
 inline unsigned int RtMidiIn :: getPortCount( void ) { return rtapi_->getPortCount(); }
 inline std::string RtMidiIn :: getPortName( unsigned int portNumber ) { return rtapi_->getPortName( portNumber ); }
 inline void RtMidiIn :: ignoreTypes( bool midiSysex, bool midiTime, bool midiSense ) { static_cast<MidiInApi *>(rtapi_)->ignoreTypes( midiSysex, midiTime, midiSense ); }
+inline void RtMidiIn :: setStatusFilter( const std::vector<unsigned char> &statusBytes ) { static_cast<MidiInApi *>(rtapi_)->setStatusFilter( statusBytes ); }
+inline void RtMidiIn :: clearStatusFilter( void ) { static_cast<MidiInApi *>(rtapi_)->clearStatusFilter(); }
 inline double RtMidiIn :: getMessage( std::vector<unsigned char> *message ) { return static_cast<MidiInApi *>(rtapi_)->getMessage( message ); }
 inline void RtMidiIn :: setErrorCallback( RtMidiErrorCallback errorCallback, void *userData ) { rtapi_->setErrorCallback(errorCallback, userData); }
 inline void RtMidiIn :: setBufferSize( unsigned int size, unsigned int count ) { static_cast<MidiInApi *>(rtapi_)->setBufferSize(size, count); }
@@ -673,6 +728,8 @@ inline unsigned int RtMidiOut :: getPortCount( void ) { return rtapi_->getPortCo
 inline std::string RtMidiOut :: getPortName( unsigned int portNumber ) { return rtapi_->getPortName( portNumber ); }
 inline void RtMidiOut :: sendMessage( const std::vector<unsigned char> *message ) { static_cast<MidiOutApi *>(rtapi_)->sendMessage( &message->at(0), message->size() ); }
 inline void RtMidiOut :: sendMessage( const unsigned char *message, size_t size ) { static_cast<MidiOutApi *>(rtapi_)->sendMessage( message, size ); }
+inline void RtMidiOut :: sendMessages( const std::vector< std::vector<unsigned char> > &messages ) { static_cast<MidiOutApi *>(rtapi_)->sendMessages( messages ); }
+inline void RtMidiOut :: scheduleMessage( const unsigned char *message, size_t size, double delay ) { static_cast<MidiOutApi *>(rtapi_)->scheduleMessage( message, size, delay ); }
 inline void RtMidiOut :: setErrorCallback( RtMidiErrorCallback errorCallback, void *userData ) { rtapi_->setErrorCallback(errorCallback, userData); }
 
 }
@@ -0,0 +1,37 @@
+#pragma once
+// Whole-file reads and crash-safe writes for profiles and config. Nothing
+// here keeps a handle or a view open after it returns, so a file that was
+// loaded can always be replaced by a later save.
+#include <windows.h>
+#include <string>
+
+// Reads the whole file into bytes. Files of 4 GB or more are refused.
+inline bool ReadFileBytes(const std::wstring& path, std::string& bytes) {
+    HANDLE h = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size = {};
+    bool ok = GetFileSizeEx(h, &size) && size.QuadPart < 0xFFFFFFFFll;
+    DWORD read = 0;
+    if (ok) {
+        bytes.resize((size_t)size.QuadPart);
+        ok = bytes.empty() || (ReadFile(h, bytes.data(), (DWORD)bytes.size(), &read, nullptr) && read == bytes.size());
+    }
+    CloseHandle(h);
+    return ok;
+}
+
+// Temp file, flushed to disk, then renamed over the target: a crash leaves
+// either the old file or the new one, never a torn one.
+inline bool WriteFileAtomic(const std::wstring& path, const std::string& bytes) {
+    std::wstring tmp = path + L".tmp";
+    HANDLE h = CreateFileW(tmp.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) return false;
+    DWORD written = 0;
+    bool ok = WriteFile(h, bytes.data(), (DWORD)bytes.size(), &written, nullptr)
+              && written == bytes.size() && FlushFileBuffers(h);
+    CloseHandle(h);
+    if (ok) ok = MoveFileExW(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+    if (!ok) DeleteFileW(tmp.c_str());
+    return ok;
+}
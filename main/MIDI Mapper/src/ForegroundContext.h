@@ -0,0 +1,194 @@
+#pragma once
+// Foreground app/title tracking, kept free of any windowing API so it can be
+// driven by a scripted provider off Windows. The platform side only answers
+// "which process owns this window", "what is that process's image" and
+// "what is this window's title"; caching, interning and title debouncing
+// happen here.
+// A pid can be handed to a new process once the old one exits, so a process
+// is only cached while the provider watches it: the provider reports its exit
+// through ContextTracker::ForgetProcess, and a cache hit costs no system call.
+#include <cstdint>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+using WindowId = std::uintptr_t;
+
+// ── Provider ──
+class ForegroundProvider {
+public:
+    virtual ~ForegroundProvider() = default;
+    virtual std::uint32_t WindowProcess(WindowId window) = 0;                  // 0 if unknown
+    virtual bool ProcessImage(std::uint32_t pid, std::wstring& image) = 0;     // file name only
+    virtual std::wstring WindowTitle(WindowId window) = 0;
+    // Report this process's exit through ForgetProcess until UnwatchProcess.
+    // False if it cannot be watched; it is then read again on every switch.
+    virtual bool WatchProcess(std::uint32_t pid) = 0;
+    virtual void UnwatchProcess(std::uint32_t pid) = 0;
+};
+
+// Stand-in that answers from tables and counts the calls, for headless runs
+class ScriptedForegroundProvider : public ForegroundProvider {
+public:
+    std::map<WindowId, std::uint32_t> processes;
+    std::map<std::uint32_t, std::wstring> images;
+    std::map<WindowId, std::wstring> titles;
+    std::set<std::uint32_t> unwatchable, watched;
+    int imageCalls = 0, titleCalls = 0;
+
+    std::uint32_t WindowProcess(WindowId window) override {
+        auto it = processes.find(window);
+        return it != processes.end() ? it->second : 0;
+    }
+    bool ProcessImage(std::uint32_t pid, std::wstring& image) override {
+        imageCalls++;
+        auto it = images.find(pid);
+        if (it == images.end()) return false;
+        image = it->second;
+        return true;
+    }
+    std::wstring WindowTitle(WindowId window) override {
+        titleCalls++;
+        auto it = titles.find(window);
+        return it != titles.end() ? it->second : std::wstring();
+    }
+    bool WatchProcess(std::uint32_t pid) override {
+        if (unwatchable.count(pid)) return false;
+        watched.insert(pid);
+        return true;
+    }
+    void UnwatchProcess(std::uint32_t pid) override { watched.erase(pid); }
+};
+
+// ── Interning ──
+// Ids are never reused, even after the table is trimmed, so an id seen
+// earlier can only ever mean the string it was given for.
+class StringInterner {
+public:
+    explicit StringInterner(size_t limit = 4096) : m_limit(limit) {}
+
+    int Intern(const std::wstring& s) {
+        auto it = m_ids.find(s);
+        if (it != m_ids.end()) return it->second;
+        if (m_ids.size() >= m_limit) m_ids.clear(); // titles with clocks or counters in them
+        return m_ids.emplace(s, m_next++).first->second;
+    }
+
+private:
+    std::unordered_map<std::wstring, int> m_ids;
+    size_t m_limit;
+    int m_next = 0;
+};
+
+// ── Tracker ──
+struct ForegroundState {
+    WindowId window = 0;
+    std::uint32_t pid = 0;
+    std::wstring app, title;
+    int appId = -1, titleId = -1;
+};
+
+class ContextTracker {
+public:
+    // cacheSize: processes whose image is remembered. titleDebounceMs: a title
+    // change is published at most this often, measured from the first change.
+    ContextTracker(ForegroundProvider& provider, size_t cacheSize = 64, std::uint64_t titleDebounceMs = 150)
+        : m_provider(provider), m_cacheSize(cacheSize), m_debounceMs(titleDebounceMs) {}
+    ~ContextTracker() {
+        for (auto& cached : m_cache) m_provider.UnwatchProcess(cached.pid);
+    }
+
+    // A window came to the front. True if the published app or title changed.
+    bool OnForeground(WindowId window) {
+        if (window == m_state.window && m_state.appId >= 0) return false; // focus bounced back
+        std::uint32_t pid = m_provider.WindowProcess(window);
+        std::wstring image;
+        if (!pid || !LookupImage(pid, image)) return false;
+        m_pendingTitle = false;
+        ForegroundState next;
+        next.window = window;
+        next.pid = pid;
+        next.app = std::move(image);
+        next.appId = m_apps.Intern(next.app);
+        next.title = m_provider.WindowTitle(window);
+        next.titleId = m_titles.Intern(next.title);
+        bool changed = next.appId != m_state.appId || next.titleId != m_state.titleId;
+        m_state = std::move(next);
+        return changed;
+    }
+
+    // A window's title changed. Only the foreground window's counts, and the
+    // title is read once the debounce window has passed (see Poll). True if
+    // this opened a new debounce window, i.e. the caller should arm a timer.
+    bool OnNameChange(WindowId window, std::uint64_t nowMs) {
+        if (window != m_state.window || m_state.appId < 0 || m_pendingTitle) return false;
+        m_titleDue = nowMs + m_debounceMs;
+        m_pendingTitle = true;
+        return true;
+    }
+
+    // True if a debounced title change was published
+    bool Poll(std::uint64_t nowMs) {
+        if (!m_pendingTitle || nowMs < m_titleDue) return false;
+        m_pendingTitle = false;
+        std::wstring title = m_provider.WindowTitle(m_state.window);
+        int id = m_titles.Intern(title);
+        if (id == m_state.titleId) return false;
+        m_state.title = std::move(title);
+        m_state.titleId = id;
+        return true;
+    }
+
+    // When Poll has work, or 0
+    std::uint64_t NextDue() const { return m_pendingTitle ? m_titleDue : 0; }
+
+    // The process went away; its pid may be handed to another one
+    void ForgetProcess(std::uint32_t pid) {
+        auto it = m_cacheIndex.find(pid);
+        if (it == m_cacheIndex.end()) return;
+        m_cache.erase(it->second);
+        m_cacheIndex.erase(it);
+        m_provider.UnwatchProcess(pid);
+    }
+
+    const ForegroundState& Current() const { return m_state; }
+    int CacheHits() const { return m_hits; }
+    int CacheMisses() const { return m_misses; }
+
+private:
+    struct CachedProcess {
+        std::uint32_t pid;
+        std::wstring image;
+    };
+
+    // Most recently used process first
+    bool LookupImage(std::uint32_t pid, std::wstring& image) {
+        auto it = m_cacheIndex.find(pid);
+        if (it != m_cacheIndex.end()) {
+            m_cache.splice(m_cache.begin(), m_cache, it->second);
+            image = it->second->image;
+            m_hits++;
+            return true;
+        }
+        m_misses++;
+        if (!m_provider.ProcessImage(pid, image)) return false;
+        if (!m_provider.WatchProcess(pid)) return true; // its pid could be reused unseen
+        m_cache.push_front({pid, image});
+        m_cacheIndex[pid] = m_cache.begin();
+        if (m_cache.size() > m_cacheSize) ForgetProcess(m_cache.back().pid);
+        return true;
+    }
+
+    ForegroundProvider& m_provider;
+    size_t m_cacheSize;
+    std::uint64_t m_debounceMs;
+    std::list<CachedProcess> m_cache;
+    std::unordered_map<std::uint32_t, std::list<CachedProcess>::iterator> m_cacheIndex;
+    StringInterner m_apps, m_titles;
+    ForegroundState m_state;
+    bool m_pendingTitle = false;
+    std::uint64_t m_titleDue = 0;
+    int m_hits = 0, m_misses = 0;
+};
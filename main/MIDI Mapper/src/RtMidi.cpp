@@ -199,6 +199,27 @@ class MidiInAlsa: public MidiInApi
   void setPortName( const std::string &portName);
   unsigned int getPortCount( void );
   std::string getPortName( unsigned int portNumber );
+  void setStatusFilter( const std::vector<unsigned char> &statusBytes );
+  void clearStatusFilter( void );
+
+ protected:
+  void initialize( const std::string& clientName );
+  void setEventFilter( const std::vector<unsigned char> *statusBytes );
+};
+
+class MidiInAlsaRaw: public MidiInApi
+{
+ public:
+  MidiInAlsaRaw( const std::string &clientName, unsigned int queueSizeLimit );
+  ~MidiInAlsaRaw( void );
+  RtMidi::Api getCurrentApi( void ) { return RtMidi::LINUX_ALSA_RAW; };
+  void openPort( unsigned int portNumber, const std::string &portName );
+  void openVirtualPort( const std::string &portName );
+  void closePort( void );
+  void setClientName( const std::string &clientName );
+  void setPortName( const std::string &portName);
+  unsigned int getPortCount( void );
+  std::string getPortName( unsigned int portNumber );
 
  protected:
   void initialize( const std::string& clientName );
@@ -218,9 +239,12 @@ class MidiOutAlsa: public MidiOutApi
   unsigned int getPortCount( void );
   std::string getPortName( unsigned int portNumber );
   void sendMessage( const unsigned char *message, size_t size );
+  void sendMessages( const std::vector< std::vector<unsigned char> > &messages );
+  void scheduleMessage( const unsigned char *message, size_t size, double delay );
 
  protected:
   void initialize( const std::string& clientName );
+  bool outputMessage( const unsigned char *message, size_t size, double delay );
 };
 
 #endif
@@ -497,6 +521,7 @@ const char* rtmidi_api_names[][2] = {
   { "web"         , "Web MIDI API" },
   { "winuwp"      , "Windows UWP" },
   { "amidi"       , "Android MIDI API" },
+  { "alsaraw"     , "ALSA RawMIDI" },
 };
 const unsigned int rtmidi_num_api_names =
   sizeof(rtmidi_api_names)/sizeof(rtmidi_api_names[0]);
@@ -571,6 +596,12 @@ RtMidi::Api RtMidi :: getCompiledApiByName( const std::string &name )
   for (i = 0; i < rtmidi_num_compiled_apis; ++i)
     if (name == rtmidi_api_names[rtmidi_compiled_apis[i]][0])
       return rtmidi_compiled_apis[i];
+#if defined(__LINUX_ALSA__)
+  // Input only and without virtual ports, so it is left out of the search
+  // order above and only used when asked for by name
+  if (name == rtmidi_api_names[RtMidi::LINUX_ALSA_RAW][0])
+    return RtMidi::LINUX_ALSA_RAW;
+#endif
   return RtMidi::UNSPECIFIED;
 }
 
@@ -601,6 +632,8 @@ void RtMidiIn :: openMidiApi( RtMidi::Api api, const std::string &clientName, un
 #if defined(__LINUX_ALSA__)
   if ( api == LINUX_ALSA )
     rtapi_ = new MidiInAlsa( clientName, queueSizeLimit );
+  if ( api == LINUX_ALSA_RAW )
+    rtapi_ = new MidiInAlsaRaw( clientName, queueSizeLimit );
 #endif
 #if defined(__WINDOWS_MM__)
   if ( api == WINDOWS_MM )
@@ -850,6 +883,23 @@ void MidiInApi :: ignoreTypes( bool midiSysex, bool midiTime, bool midiSense )
   if ( midiSense ) inputData_.ignoreFlags |= 0x04;
 }
 
+void MidiInApi :: setStatusFilter( const std::vector<unsigned char> &statusBytes )
+{
+  // Built aside and stored a word at a time, so the input thread never sees
+  // a half-cleared filter: a status both filters accept stays accepted.
+  unsigned long long bits[4] = { 0, 0, 0, 0 };
+  for ( unsigned int i=0; i<statusBytes.size(); ++i )
+    bits[statusBytes[i] >> 6] |= 1ULL << ( statusBytes[i] & 63 );
+  for ( unsigned int i=0; i<4; ++i )
+    inputData_.statusFilter[i].store( bits[i], std::memory_order_relaxed );
+  inputData_.filterStatus.store( true, std::memory_order_release );
+}
+
+void MidiInApi :: clearStatusFilter( void )
+{
+  inputData_.filterStatus.store( false, std::memory_order_release );
+}
+
 double MidiInApi :: getMessage( std::vector<unsigned char> *message )
 {
   message->clear();
@@ -943,6 +993,20 @@ MidiOutApi :: ~MidiOutApi( void )
 {
 }
 
+void MidiOutApi :: sendMessages( const std::vector< std::vector<unsigned char> > &messages )
+{
+  for ( size_t i=0; i<messages.size(); ++i ) {
+    if ( messages[i].empty() ) continue;
+    sendMessage( &messages[i][0], messages[i].size() );
+  }
+}
+
+void MidiOutApi :: scheduleMessage( const unsigned char *message, size_t size, double /*delay*/ )
+{
+  // No scheduler available: deliver now.
+  sendMessage( message, size );
+}
+
 // *************************************************** //
 //
 // OS/API-specific methods.
@@ -1763,9 +1827,8 @@ struct AlsaMidiData {
   int vport;
   snd_seq_port_subscribe_t *subscription;
   snd_midi_event_t *coder;
-  unsigned int bufferSize;
+  unsigned int bufferSize; // input: decode buffer; output: encoder buffer
   unsigned int requestedBufferSize;
-  unsigned char *buffer;
   pthread_t thread;
   pthread_t dummy_thread_id;
   snd_seq_real_time_t lastTime;
@@ -1971,6 +2034,7 @@ static void *alsaMidiHandler( void *ptr )
 
     snd_seq_free_event( ev );
     if ( message.bytes.size() == 0 || continueSysex ) continue;
+    if ( !data->acceptsStatus( message.bytes[0] ) ) continue;
 
     if ( data->usingCallback ) {
       RtMidiIn::RtMidiCallback callback = (RtMidiIn::RtMidiCallback) data->userCallback;
@@ -2359,6 +2423,86 @@ void MidiInAlsa :: setPortName( const std::string &portName )
   snd_seq_set_port_info( data->seq, data->vport, pinfo );
 }
 
+// Maps a MIDI status byte to the ALSA sequencer event types it can be
+// delivered as.  Returns the number of types written to 'types'.
+static int alsaEventTypes( unsigned char status, int *types )
+{
+  switch ( status & 0xF0 ) {
+  case 0x80: types[0] = SND_SEQ_EVENT_NOTEOFF; return 1;
+  case 0x90: types[0] = SND_SEQ_EVENT_NOTEON; types[1] = SND_SEQ_EVENT_NOTE; return 2;
+  case 0xA0: types[0] = SND_SEQ_EVENT_KEYPRESS; return 1;
+  case 0xB0:
+    types[0] = SND_SEQ_EVENT_CONTROLLER; types[1] = SND_SEQ_EVENT_CONTROL14;
+    types[2] = SND_SEQ_EVENT_NONREGPARAM; types[3] = SND_SEQ_EVENT_REGPARAM;
+    return 4;
+  case 0xC0: types[0] = SND_SEQ_EVENT_PGMCHANGE; return 1;
+  case 0xD0: types[0] = SND_SEQ_EVENT_CHANPRESS; return 1;
+  case 0xE0: types[0] = SND_SEQ_EVENT_PITCHBEND; return 1;
+  }
+
+  switch ( status ) {
+  case 0xF0: types[0] = SND_SEQ_EVENT_SYSEX; return 1;
+  case 0xF1: types[0] = SND_SEQ_EVENT_QFRAME; return 1;
+  case 0xF2: types[0] = SND_SEQ_EVENT_SONGPOS; return 1;
+  case 0xF3: types[0] = SND_SEQ_EVENT_SONGSEL; return 1;
+  case 0xF6: types[0] = SND_SEQ_EVENT_TUNE_REQUEST; return 1;
+  case 0xF8: types[0] = SND_SEQ_EVENT_CLOCK; return 1;
+  case 0xF9: types[0] = SND_SEQ_EVENT_TICK; return 1;
+  case 0xFA: types[0] = SND_SEQ_EVENT_START; return 1;
+  case 0xFB: types[0] = SND_SEQ_EVENT_CONTINUE; return 1;
+  case 0xFC: types[0] = SND_SEQ_EVENT_STOP; return 1;
+  case 0xFE: types[0] = SND_SEQ_EVENT_SENSING; return 1;
+  case 0xFF: types[0] = SND_SEQ_EVENT_RESET; return 1;
+  }
+  return 0;
+}
+
+void MidiInAlsa :: setStatusFilter( const std::vector<unsigned char> &statusBytes )
+{
+  MidiInApi::setStatusFilter( statusBytes );
+  setEventFilter( &statusBytes );
+}
+
+void MidiInAlsa :: clearStatusFilter( void )
+{
+  MidiInApi::clearStatusFilter();
+  setEventFilter( NULL );
+}
+
+// Installs (or with a NULL argument removes) the sequencer client event
+// filter.  The sequencer filters by event type only, so channel selection
+// is left to the userspace check in alsaMidiHandler().
+void MidiInAlsa :: setEventFilter( const std::vector<unsigned char> *statusBytes )
+{
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
+  snd_seq_client_info_t *cinfo;
+  snd_seq_client_info_alloca( &cinfo );
+  if ( snd_seq_get_client_info( data->seq, cinfo ) < 0 ) {
+    errorString_ = "MidiInAlsa::setEventFilter: error reading ALSA client info.";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  snd_seq_client_info_event_filter_clear( cinfo );
+  if ( statusBytes ) {
+    // Adding a type switches the filter on; removing it again leaves an
+    // empty filter that blocks everything if no other type is listed.
+    snd_seq_client_info_event_filter_add( cinfo, SND_SEQ_EVENT_NONE );
+    snd_seq_client_info_event_filter_del( cinfo, SND_SEQ_EVENT_NONE );
+    int types[4];
+    for ( unsigned int i=0; i<statusBytes->size(); ++i ) {
+      int nTypes = alsaEventTypes( (*statusBytes)[i], types );
+      for ( int j=0; j<nTypes; ++j )
+        snd_seq_client_info_event_filter_add( cinfo, types[j] );
+    }
+  }
+
+  if ( snd_seq_set_client_info( data->seq, cinfo ) < 0 ) {
+    errorString_ = "MidiInAlsa::setEventFilter: error installing ALSA client event filter.";
+    error( RtMidiError::WARNING, errorString_ );
+  }
+}
+
 //*********************************************************************//
 //  API: LINUX ALSA
 //  Class Definitions: MidiOutAlsa
@@ -2377,8 +2521,8 @@ MidiOutAlsa :: ~MidiOutAlsa()
   // Cleanup.
   AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
   if ( data->vport >= 0 ) snd_seq_delete_port( data->seq, data->vport );
+  if ( data->queue_id >= 0 ) snd_seq_free_queue( data->seq, data->queue_id );
   if ( data->coder ) snd_midi_event_free( data->coder );
-  if ( data->buffer ) free( data->buffer );
   snd_seq_close( data->seq );
   delete data;
 }
@@ -2402,9 +2546,9 @@ void MidiOutAlsa :: initialize( const std::string& clientName )
   data->seq = seq;
   data->portNum = -1;
   data->vport = -1;
+  data->queue_id = -1; // allocated on first scheduled send
   data->bufferSize = 32;
   data->coder = 0;
-  data->buffer = 0;
   int result = snd_midi_event_new( data->bufferSize, &data->coder );
   if ( result < 0 ) {
     delete data;
@@ -2412,13 +2556,6 @@ void MidiOutAlsa :: initialize( const std::string& clientName )
     error( RtMidiError::DRIVER_ERROR, errorString_ );
     return;
   }
-  data->buffer = (unsigned char *) malloc( data->bufferSize );
-  if ( data->buffer == NULL ) {
-    delete data;
-    errorString_ = "MidiOutAlsa::initialize: error allocating buffer memory!\n\n";
-    error( RtMidiError::MEMORY_ERROR, errorString_ );
-    return;
-  }
   snd_midi_event_init( data->coder );
   apiData_ = (void *) data;
 }
@@ -2571,7 +2708,10 @@ void MidiOutAlsa :: openVirtualPort( const std::string &portName )
   }
 }
 
-void MidiOutAlsa :: sendMessage( const unsigned char *message, size_t size )
+// Encodes one message into the client's output buffer without flushing.
+// A non-negative 'delay' (seconds) schedules the events on the output
+// queue relative to the current queue time; otherwise they are direct.
+bool MidiOutAlsa :: outputMessage( const unsigned char *message, size_t size, double delay )
 {
   long result;
   AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
@@ -2582,53 +2722,492 @@ void MidiOutAlsa :: sendMessage( const unsigned char *message, size_t size )
     if ( result != 0 ) {
       errorString_ = "MidiOutAlsa::sendMessage: ALSA error resizing MIDI event buffer.";
       error( RtMidiError::DRIVER_ERROR, errorString_ );
-      return;
-    }
-    free (data->buffer);
-    data->buffer = (unsigned char *) malloc( data->bufferSize );
-    if ( data->buffer == NULL ) {
-      errorString_ = "MidiOutAlsa::initialize: error allocating buffer memory!\n\n";
-      error( RtMidiError::MEMORY_ERROR, errorString_ );
-      return;
+      return false;
     }
   }
 
-  for ( unsigned int i=0; i<nBytes; ++i ) data->buffer[i] = message[i];
-
+  // The encoder reads the caller's bytes directly; no staging copy.
   unsigned int offset = 0;
   while (offset < nBytes) {
     snd_seq_event_t ev;
     snd_seq_ev_clear( &ev );
     snd_seq_ev_set_source( &ev, data->vport );
     snd_seq_ev_set_subs( &ev );
-    snd_seq_ev_set_direct( &ev );
-    result = snd_midi_event_encode( data->coder, data->buffer + offset,
+    if ( delay >= 0.0 ) {
+      snd_seq_real_time_t when;
+      when.tv_sec = (unsigned int) delay;
+      when.tv_nsec = (unsigned int) ( ( delay - when.tv_sec ) * 1e9 );
+      snd_seq_ev_schedule_real( &ev, data->queue_id, 1, &when );
+    }
+    else
+      snd_seq_ev_set_direct( &ev );
+    result = snd_midi_event_encode( data->coder, message + offset,
                                     (long)(nBytes - offset), &ev );
     if ( result < 0 ) {
       errorString_ = "MidiOutAlsa::sendMessage: event parsing error!";
       error( RtMidiError::WARNING, errorString_ );
-      return;
+      return false;
     }
 
     if ( ev.type == SND_SEQ_EVENT_NONE ) {
       errorString_ = "MidiOutAlsa::sendMessage: incomplete message!";
       error( RtMidiError::WARNING, errorString_ );
-      return;
+      return false;
     }
 
     offset += result;
 
-    // Send the event.
+    // Queue the event.  The client is non-blocking, so a full output
+    // buffer is flushed and the event retried once.
     result = snd_seq_event_output( data->seq, &ev );
+    if ( result == -EAGAIN ) {
+      snd_seq_drain_output( data->seq );
+      result = snd_seq_event_output( data->seq, &ev );
+    }
     if ( result < 0 ) {
       errorString_ = "MidiOutAlsa::sendMessage: error sending MIDI message to port.";
       error( RtMidiError::WARNING, errorString_ );
-      return;
+      return false;
     }
   }
+  return true;
+}
+
+void MidiOutAlsa :: sendMessage( const unsigned char *message, size_t size )
+{
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
+  if ( outputMessage( message, size, -1.0 ) )
+    snd_seq_drain_output( data->seq );
+}
+
+void MidiOutAlsa :: sendMessages( const std::vector< std::vector<unsigned char> > &messages )
+{
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
+  for ( size_t i=0; i<messages.size(); ++i ) {
+    if ( messages[i].empty() ) continue;
+    if ( !outputMessage( &messages[i][0], messages[i].size(), -1.0 ) ) break;
+  }
+
+  // Whatever was encoded goes out in a single flush.
   snd_seq_drain_output( data->seq );
 }
 
+void MidiOutAlsa :: scheduleMessage( const unsigned char *message, size_t size, double delay )
+{
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
+  if ( delay <= 0.0 ) {
+    sendMessage( message, size );
+    return;
+  }
+
+  if ( data->queue_id < 0 ) {
+    data->queue_id = snd_seq_alloc_named_queue( data->seq, "RtMidi Output Queue" );
+    if ( data->queue_id < 0 ) {
+      errorString_ = "MidiOutAlsa::scheduleMessage: error allocating output queue.";
+      error( RtMidiError::DRIVER_ERROR, errorString_ );
+      return;
+    }
+    snd_seq_start_queue( data->seq, data->queue_id, NULL );
+    snd_seq_drain_output( data->seq );
+  }
+
+  if ( outputMessage( message, size, delay ) )
+    snd_seq_drain_output( data->seq );
+}
+
+//*********************************************************************//
+//  API: LINUX ALSA RAWMIDI
+//  Class Definitions: MidiInAlsaRaw
+//*********************************************************************//
+
+// The rawmidi backend reads bytes straight from /dev/snd/midiC*D* and
+// parses them in userspace, skipping the sequencer's routing and the
+// encode/decode round trip.  The device is opened exclusively, so it is
+// meant for controllers that are not shared with other applications.
+
+// Incremental MIDI 1.0 byte-stream parser.  Handles running status,
+// realtime bytes interleaved anywhere (including inside sysex) and
+// sysex up to maxSysex bytes; a longer one (say, an F0 whose F7 never
+// comes) is dropped, and its remaining data bytes with it.  Buffers are
+// swapped rather than copied, so steady-state parsing does not allocate.
+struct MidiStreamParser {
+  std::vector<unsigned char> pending;
+  unsigned char runningStatus;
+  unsigned int expected; // data bytes still missing from 'pending'
+  bool inSysex;
+  size_t maxSysex;
+
+  MidiStreamParser()
+    : runningStatus(0), expected(0), inSysex(false), maxSysex(65536) {}
+
+  void reset() { pending.clear(); runningStatus = 0; expected = 0; inSysex = false; }
+
+  // Feeds one byte.  Returns true when 'out' holds a complete message.
+  bool parse( unsigned char byte, std::vector<unsigned char> &out );
+};
+
+bool MidiStreamParser :: parse( unsigned char byte, std::vector<unsigned char> &out )
+{
+  if ( byte >= 0xF8 ) {
+    // Realtime messages leave any message in progress untouched.
+    if ( byte == 0xF9 || byte == 0xFD ) return false; // undefined
+    out.assign( 1, byte );
+    return true;
+  }
+
+  if ( byte == 0xF7 ) {
+    if ( !inSysex ) return false;
+    inSysex = false;
+    pending.push_back( byte );
+    out.swap( pending );
+    pending.clear();
+    return true;
+  }
+
+  if ( byte & 0x80 ) {
+    // Any other status byte terminates an unfinished message or sysex.
+    inSysex = false;
+    pending.clear();
+
+    if ( byte == 0xF0 ) {
+      inSysex = true;
+      runningStatus = 0;
+      pending.push_back( byte );
+      return false;
+    }
+
+    if ( byte > 0xF0 ) {
+      // System common messages cancel running status.
+      runningStatus = 0;
+      if ( byte == 0xF4 || byte == 0xF5 ) return false; // undefined
+      expected = ( byte == 0xF2 ) ? 2 : ( byte == 0xF1 || byte == 0xF3 ) ? 1 : 0;
+      if ( expected == 0 ) {
+        out.assign( 1, byte );
+        return true;
+      }
+      pending.push_back( byte );
+      return false;
+    }
+
+    runningStatus = byte;
+    expected = ( ( byte & 0xE0 ) == 0xC0 ) ? 1 : 2;
+    pending.push_back( byte );
+    return false;
+  }
+
+  // Data byte.
+  if ( inSysex ) {
+    if ( pending.size() + 1 >= maxSysex ) { // no room left for the F7
+      inSysex = false;
+      pending.clear();
+      return false;
+    }
+    pending.push_back( byte );
+    return false;
+  }
+
+  if ( pending.empty() ) {
+    if ( runningStatus == 0 ) return false; // stray data byte
+    expected = ( ( runningStatus & 0xE0 ) == 0xC0 ) ? 1 : 2;
+    pending.push_back( runningStatus );
+  }
+
+  pending.push_back( byte );
+  if ( --expected > 0 ) return false;
+
+  out.swap( pending );
+  pending.clear();
+  return true;
+}
+
+// A structure to hold variables related to the ALSA rawmidi
+// implementation.
+struct AlsaRawMidiData {
+  snd_rawmidi_t *handle;
+  pthread_t thread;
+  pthread_t dummy_thread_id;
+  int trigger_fds[2];
+  struct timespec lastTime;
+  MidiStreamParser parser;
+  MidiApi *owner;          // reports a lost device from the input thread
+  std::atomic<bool> lost;  // the input thread stopped because the device went away
+};
+
+// This function is used to count the rawmidi input subdevices or to get
+// the device string ("hw:C,D,S") and display name for a given port number.
+static unsigned int rawmidiPortInfo( int portNumber, std::string *device, std::string *name )
+{
+  int count = 0;
+  int card = -1;
+  while ( snd_card_next( &card ) >= 0 && card >= 0 ) {
+    char ctlName[32];
+    snprintf( ctlName, sizeof( ctlName ), "hw:%d", card );
+    snd_ctl_t *ctl;
+    if ( snd_ctl_open( &ctl, ctlName, 0 ) < 0 ) continue;
+
+    int dev = -1;
+    while ( snd_ctl_rawmidi_next_device( ctl, &dev ) >= 0 && dev >= 0 ) {
+      snd_rawmidi_info_t *info;
+      snd_rawmidi_info_alloca( &info );
+      snd_rawmidi_info_set_device( info, dev );
+      snd_rawmidi_info_set_subdevice( info, 0 );
+      snd_rawmidi_info_set_stream( info, SND_RAWMIDI_STREAM_INPUT );
+      if ( snd_ctl_rawmidi_info( ctl, info ) < 0 ) continue;
+
+      unsigned int nSub = snd_rawmidi_info_get_subdevices_count( info );
+      for ( unsigned int sub = 0; sub < nSub; ++sub ) {
+        if ( count == portNumber ) {
+          snd_rawmidi_info_set_subdevice( info, sub );
+          snd_ctl_rawmidi_info( ctl, info );
+          std::ostringstream os;
+          os << "hw:" << card << "," << dev << "," << sub;
+          if ( device ) *device = os.str();
+          if ( name ) {
+            const char *subName = snd_rawmidi_info_get_subdevice_name( info );
+            *name = ( subName && subName[0] ) ? subName : snd_rawmidi_info_get_name( info );
+            *name += " " + os.str();
+          }
+          snd_ctl_close( ctl );
+          return 1;
+        }
+        ++count;
+      }
+    }
+    snd_ctl_close( ctl );
+  }
+
+  // If a negative portNumber was used, return the port count.
+  if ( portNumber < 0 ) return count;
+  return 0;
+}
+
+static void *alsaRawMidiHandler( void *ptr )
+{
+  MidiInApi::RtMidiInData *data = static_cast<MidiInApi::RtMidiInData *> (ptr);
+  AlsaRawMidiData *apiData = static_cast<AlsaRawMidiData *> (data->apiData);
+
+  unsigned char buffer[256];
+  MidiInApi::MidiMessage message;
+  struct timespec now;
+
+  int poll_fd_count = snd_rawmidi_poll_descriptors_count( apiData->handle ) + 1;
+  struct pollfd *poll_fds = (struct pollfd*)alloca( poll_fd_count * sizeof( struct pollfd ));
+  snd_rawmidi_poll_descriptors( apiData->handle, poll_fds + 1, poll_fd_count - 1 );
+  poll_fds[0].fd = apiData->trigger_fds[0];
+  poll_fds[0].events = POLLIN;
+
+  while ( data->doInput ) {
+
+    if ( poll( poll_fds, poll_fd_count, -1 ) < 0 ) continue;
+    if ( poll_fds[0].revents & POLLIN ) {
+      bool dummy;
+      int res = read( poll_fds[0].fd, &dummy, sizeof(dummy) );
+      (void) res;
+      continue;
+    }
+
+    // Drain everything the driver has buffered; the handle is non-blocking.
+    while ( data->doInput ) {
+      ssize_t nBytes = snd_rawmidi_read( apiData->handle, buffer, sizeof( buffer ) );
+      if ( nBytes == -EAGAIN ) break;
+      if ( nBytes < 0 ) {
+        if ( nBytes == -ENODEV ) { // device unplugged
+          data->doInput = false;
+          apiData->lost = true;
+          apiData->owner->error( RtMidiError::WARNING, "MidiInAlsaRaw::alsaRawMidiHandler: the device was disconnected; close or reopen the port." );
+          break;
+        }
+        std::cerr << "\nMidiInAlsaRaw::alsaRawMidiHandler: rawmidi read error: " << snd_strerror( (int) nBytes ) << "\n\n";
+        break;
+      }
+
+      clock_gettime( CLOCK_MONOTONIC, &now );
+      for ( ssize_t i = 0; i < nBytes; ++i ) {
+        if ( !apiData->parser.parse( buffer[i], message.bytes ) ) continue;
+
+        unsigned char status = message.bytes[0];
+        if ( status == 0xF0 && ( data->ignoreFlags & 0x01 ) ) continue;
+        if ( ( status == 0xF1 || status == 0xF8 ) && ( data->ignoreFlags & 0x02 ) ) continue;
+        if ( status == 0xFE && ( data->ignoreFlags & 0x04 ) ) continue;
+        if ( !data->acceptsStatus( status ) ) continue;
+
+        // All bytes of one read share the arrival time of that read.
+        message.timeStamp = 0.0;
+        if ( data->firstMessage == true )
+          data->firstMessage = false;
+        else
+          message.timeStamp = ( now.tv_sec - apiData->lastTime.tv_sec ) +
+                              ( now.tv_nsec - apiData->lastTime.tv_nsec ) * 1e-9;
+        apiData->lastTime = now;
+
+        if ( data->usingCallback ) {
+          RtMidiIn::RtMidiCallback callback = (RtMidiIn::RtMidiCallback) data->userCallback;
+          callback( message.timeStamp, &message.bytes, data->userData );
+        }
+        else {
+          // As long as we haven't reached our queue size limit, push the message.
+          if ( !data->queue.push( message ) )
+            std::cerr << "\nMidiInAlsaRaw: message queue limit reached!!\n\n";
+        }
+      }
+    }
+  }
+
+  apiData->thread = apiData->dummy_thread_id;
+  return 0;
+}
+
+MidiInAlsaRaw :: MidiInAlsaRaw( const std::string &clientName, unsigned int queueSizeLimit )
+  : MidiInApi( queueSizeLimit )
+{
+  MidiInAlsaRaw::initialize( clientName );
+}
+
+MidiInAlsaRaw :: ~MidiInAlsaRaw()
+{
+  // Close a connection if it exists.
+  MidiInAlsaRaw::closePort();
+
+  // Cleanup.
+  AlsaRawMidiData *data = static_cast<AlsaRawMidiData *> (apiData_);
+  close ( data->trigger_fds[0] );
+  close ( data->trigger_fds[1] );
+  delete data;
+}
+
+void MidiInAlsaRaw :: initialize( const std::string& /*clientName*/ )
+{
+  // Save our api-specific connection information.
+  AlsaRawMidiData *data = new AlsaRawMidiData;
+  data->handle = 0;
+  data->dummy_thread_id = pthread_self();
+  data->thread = data->dummy_thread_id;
+  data->trigger_fds[0] = -1;
+  data->trigger_fds[1] = -1;
+  data->lastTime.tv_sec = 0;
+  data->lastTime.tv_nsec = 0;
+  data->owner = this;
+  data->lost = false;
+  apiData_ = (void *) data;
+  inputData_.apiData = (void *) data;
+
+  if ( pipe(data->trigger_fds) == -1 ) {
+    errorString_ = "MidiInAlsaRaw::initialize: error creating pipe objects.";
+    error( RtMidiError::DRIVER_ERROR, errorString_ );
+    return;
+  }
+}
+
+unsigned int MidiInAlsaRaw :: getPortCount()
+{
+  return rawmidiPortInfo( -1, NULL, NULL );
+}
+
+std::string MidiInAlsaRaw :: getPortName( unsigned int portNumber )
+{
+  std::string stringName;
+  if ( rawmidiPortInfo( (int) portNumber, NULL, &stringName ) )
+    return stringName;
+
+  // If we get here, we didn't find a match.
+  errorString_ = "MidiInAlsaRaw::getPortName: error looking for port name!";
+  error( RtMidiError::WARNING, errorString_ );
+  return stringName;
+}
+
+void MidiInAlsaRaw :: openPort( unsigned int portNumber, const std::string &/*portName*/ )
+{
+  AlsaRawMidiData *data = static_cast<AlsaRawMidiData *> (apiData_);
+  if ( connected_ && data->lost ) closePort(); // unplugged: tidy up the old handle first
+
+  if ( connected_ ) {
+    errorString_ = "MidiInAlsaRaw::openPort: a valid connection already exists!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  std::string device;
+  if ( rawmidiPortInfo( (int) portNumber, &device, NULL ) == 0 ) {
+    std::ostringstream ost;
+    ost << "MidiInAlsaRaw::openPort: the 'portNumber' argument (" << portNumber << ") is invalid.";
+    errorString_ = ost.str();
+    error( RtMidiError::INVALID_PARAMETER, errorString_ );
+    return;
+  }
+
+  int result = snd_rawmidi_open( &data->handle, NULL, device.c_str(), SND_RAWMIDI_NONBLOCK );
+  if ( result < 0 ) {
+    data->handle = 0;
+    errorString_ = "MidiInAlsaRaw::openPort: error opening rawmidi device " + device + ": " + snd_strerror( result );
+    error( RtMidiError::DRIVER_ERROR, errorString_ );
+    return;
+  }
+
+  // Discard stale bytes from a previous connection.
+  data->parser.reset();
+  inputData_.firstMessage = true;
+
+  // Start our MIDI input thread.
+  pthread_attr_t attr;
+  pthread_attr_init( &attr );
+  pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_JOINABLE );
+  pthread_attr_setschedpolicy( &attr, SCHED_OTHER );
+
+  inputData_.doInput = true;
+  int err = pthread_create( &data->thread, &attr, alsaRawMidiHandler, &inputData_ );
+  pthread_attr_destroy( &attr );
+  if ( err ) {
+    snd_rawmidi_close( data->handle );
+    data->handle = 0;
+    inputData_.doInput = false;
+    errorString_ = "MidiInAlsaRaw::openPort: error starting MIDI input thread!";
+    error( RtMidiError::THREAD_ERROR, errorString_ );
+    return;
+  }
+
+  connected_ = true;
+}
+
+void MidiInAlsaRaw :: openVirtualPort( const std::string &/*portName*/ )
+{
+  // Rawmidi devices are hardware endpoints; virtual ports need the sequencer.
+  errorString_ = "MidiInAlsaRaw::openVirtualPort: cannot be implemented with the ALSA rawmidi API!";
+  error( RtMidiError::WARNING, errorString_ );
+}
+
+void MidiInAlsaRaw :: closePort( void )
+{
+  AlsaRawMidiData *data = static_cast<AlsaRawMidiData *> (apiData_);
+
+  // Stop thread to avoid triggering the callback, while the port is intended to be closed
+  if ( inputData_.doInput ) {
+    inputData_.doInput = false;
+    int res = write( data->trigger_fds[1], &inputData_.doInput, sizeof( inputData_.doInput ) );
+    (void) res;
+  }
+  if ( !pthread_equal( data->thread, data->dummy_thread_id ) )
+    pthread_join( data->thread, NULL );
+
+  if ( data->handle ) {
+    snd_rawmidi_close( data->handle );
+    data->handle = 0;
+  }
+  data->lost = false;
+  connected_ = false;
+}
+
+void MidiInAlsaRaw :: setClientName( const std::string& )
+{
+  errorString_ = "MidiInAlsaRaw::setClientName: this function is not implemented for the LINUX_ALSA_RAW API!";
+  error( RtMidiError::WARNING, errorString_ );
+}
+
+void MidiInAlsaRaw :: setPortName( const std::string& )
+{
+  errorString_ = "MidiInAlsaRaw::setPortName: this function is not implemented for the LINUX_ALSA_RAW API!";
+  error( RtMidiError::WARNING, errorString_ );
+}
+
 #endif // __LINUX_ALSA__
 
 
@@ -2719,6 +3298,7 @@ static void CALLBACK midiInputCallback( HMIDIIN /*hmin*/,
     // Make sure the first byte is a status byte.
     unsigned char status = (unsigned char) (midiMessage & 0x000000FF);
     if ( !(status & 0x80) ) return;
+    if ( !data->acceptsStatus( status ) ) return;
 
     // Determine the number of bytes in the MIDI message.
     unsigned short nBytes = 1;
@@ -2746,7 +3326,8 @@ static void CALLBACK midiInputCallback( HMIDIIN /*hmin*/,
   }
   else { // Sysex message ( MIM_LONGDATA or MIM_LONGERROR )
     MIDIHDR *sysex = ( MIDIHDR *) midiMessage;
-    if ( !( data->ignoreFlags & 0x01 ) && inputStatus != MIM_LONGERROR ) {
+    bool ignoreSysex = ( data->ignoreFlags & 0x01 ) || !data->acceptsStatus( 0xF0 );
+    if ( !ignoreSysex && inputStatus != MIM_LONGERROR ) {
       // Sysex message and we're not ignoring it
       for ( int i=0; i<(int)sysex->dwBytesRecorded; ++i )
         apiData->message.bytes.push_back( sysex->lpData[i] );
@@ -2768,7 +3349,7 @@ static void CALLBACK midiInputCallback( HMIDIIN /*hmin*/,
       if ( result != MMSYSERR_NOERROR )
         std::cerr << "\nRtMidiIn::midiInputCallback: error sending sysex to Midi device!!\n\n";
 
-      if ( data->ignoreFlags & 0x01 ) return;
+      if ( ignoreSysex ) return;
     }
     else return;
   }
@@ -0,0 +1,247 @@
+#pragma once
+// X11 side of ContextTracker, for Linux desktops with an EWMH window manager.
+// Event-driven: the root window's _NET_ACTIVE_WINDOW and the active window's
+// _NET_WM_NAME / WM_NAME arrive as PropertyNotify, nothing is polled. A pid
+// comes from _NET_WM_PID and its image from /proc/<pid>/exe; the tracker's
+// LRU keeps that readlink off the common path. Cached processes are watched
+// through pidfds, so an exit reaches ForgetProcess before the pid is reused.
+//
+// Typical loop (link with -lX11):
+//   X11ForegroundSource x11;
+//   ContextTracker tracker(x11);
+//   if (!x11.Open()) return;
+//   while (running) {
+//       poll x11.EventFd() for input, timing out at tracker.NextDue()
+//       bool changed = tracker.Poll(nowMs);       // may queue X events,
+//       changed |= x11.Dispatch(tracker, nowMs);  // so drain them after it
+//       if (changed) publish tracker.Current()
+//   }
+// Only one source may be open at a time: Xlib's error handler is per process.
+#include "ForegroundContext.h"
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <climits>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+class X11ForegroundSource : public ForegroundProvider {
+public:
+    X11ForegroundSource() = default;
+    X11ForegroundSource(const X11ForegroundSource&) = delete;
+    X11ForegroundSource& operator=(const X11ForegroundSource&) = delete;
+    // Destroy the tracker first: it hands its watched pids back here
+    ~X11ForegroundSource() { Close(); }
+
+    // display: nullptr for $DISPLAY. False if there is no X server to talk to.
+    bool Open(const char* display = nullptr) {
+        if (m_display) return true;
+        m_display = XOpenDisplay(display);
+        if (!m_display) return false;
+        m_events = epoll_create1(EPOLL_CLOEXEC);
+        if (m_events < 0) {
+            XCloseDisplay(m_display);
+            m_display = nullptr;
+            return false;
+        }
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u32 = 0; // pid 0 is never watched, so 0 means the X connection
+        epoll_ctl(m_events, EPOLL_CTL_ADD, ConnectionNumber(m_display), &ev);
+        // Windows can vanish between an event and our query of them. Those
+        // BadWindow errors are expected; anything else goes to whoever
+        // handled errors before us.
+        s_errorDisplay = m_display;
+        s_previousHandler = XSetErrorHandler(OnXError);
+        m_root = DefaultRootWindow(m_display);
+        m_netActiveWindow = XInternAtom(m_display, "_NET_ACTIVE_WINDOW", False);
+        m_netWmName = XInternAtom(m_display, "_NET_WM_NAME", False);
+        m_netWmPid = XInternAtom(m_display, "_NET_WM_PID", False);
+        m_utf8String = XInternAtom(m_display, "UTF8_STRING", False);
+        XSelectInput(m_display, m_root, PropertyChangeMask);
+        XFlush(m_display);
+        return true;
+    }
+
+    void Close() {
+        for (auto& [pid, fd] : m_pidfds) close(fd);
+        m_pidfds.clear();
+        if (m_events >= 0) close(m_events);
+        m_events = -1;
+        if (!m_display) return;
+        XSetErrorHandler(s_previousHandler);
+        s_previousHandler = nullptr;
+        s_errorDisplay = nullptr;
+        XCloseDisplay(m_display);
+        m_display = nullptr;
+        m_active = None;
+        m_started = false;
+    }
+
+    // Readable when Dispatch has work: X events or a watched process exiting
+    int EventFd() const { return m_events; }
+
+    // Feeds queued X events and process exits to tracker. The first call also
+    // reports the window that was active before Open. True if the tracker's
+    // foreground app or title changed; debounced title changes come out of
+    // tracker.Poll.
+    bool Dispatch(ContextTracker& tracker, std::uint64_t nowMs) {
+        if (!m_display) return false;
+        epoll_event ready[16];
+        int n;
+        while ((n = epoll_wait(m_events, ready, 16, 0)) > 0) {
+            bool exits = false;
+            for (int i = 0; i < n; i++) {
+                if (!ready[i].data.u32) continue;
+                tracker.ForgetProcess(ready[i].data.u32); // closes its pidfd via UnwatchProcess
+                exits = true;
+            }
+            if (!exits) break;
+        }
+        bool changed = false;
+        if (!m_started) {
+            m_started = true;
+            changed |= Activate(tracker, ActiveWindow());
+        }
+        while (XPending(m_display)) {
+            XEvent ev;
+            XNextEvent(m_display, &ev);
+            if (ev.type != PropertyNotify) continue;
+            const XPropertyEvent& pe = ev.xproperty;
+            if (pe.window == m_root && pe.atom == m_netActiveWindow)
+                changed |= Activate(tracker, ActiveWindow());
+            else if (pe.window == m_active && (pe.atom == m_netWmName || pe.atom == XA_WM_NAME))
+                tracker.OnNameChange((WindowId)m_active, nowMs);
+        }
+        return changed;
+    }
+
+    std::uint32_t WindowProcess(WindowId window) override {
+        std::uint32_t pid = 0;
+        unsigned char* data = nullptr;
+        unsigned long count = 0;
+        if (GetProperty((Window)window, m_netWmPid, XA_CARDINAL, &data, &count) && count > 0)
+            pid = (std::uint32_t)*(unsigned long*)data; // format-32 data is handed out as longs
+        if (data) XFree(data);
+        return pid;
+    }
+
+    bool ProcessImage(std::uint32_t pid, std::wstring& image) override {
+        char path[PATH_MAX];
+        std::string link = "/proc/" + std::to_string(pid) + "/exe";
+        ssize_t n = readlink(link.c_str(), path, sizeof(path) - 1);
+        if (n <= 0) return false;
+        std::string full(path, (size_t)n);
+        image = FromUtf8(full.substr(full.find_last_of('/') + 1));
+        return true;
+    }
+
+    std::wstring WindowTitle(WindowId window) override {
+        std::wstring title;
+        unsigned char* data = nullptr;
+        unsigned long count = 0;
+        if (GetProperty((Window)window, m_netWmName, m_utf8String, &data, &count)) {
+            title = FromUtf8(std::string((const char*)data, count));
+        } else {
+            char* name = nullptr;
+            if (XFetchName(m_display, (Window)window, &name) && name) {
+                title = FromUtf8(name); // Latin-1 in theory, ASCII in practice
+                XFree(name);
+            }
+        }
+        if (data) XFree(data);
+        return title;
+    }
+
+    // A pidfd turns readable when its process exits. Dispatch drains exits
+    // before X events, so a window of a process that took over the pid is
+    // never looked up while the old process is still cached.
+    bool WatchProcess(std::uint32_t pid) override {
+#ifdef SYS_pidfd_open
+        int fd = (int)syscall(SYS_pidfd_open, (pid_t)pid, 0);
+        if (fd < 0) return false;
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u32 = pid;
+        if (epoll_ctl(m_events, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            close(fd);
+            return false;
+        }
+        m_pidfds[pid] = fd;
+        return true;
+#else
+        (void)pid;
+        return false; // no pidfds: read on every switch rather than risk a reused pid
+#endif
+    }
+
+    void UnwatchProcess(std::uint32_t pid) override {
+        auto it = m_pidfds.find(pid);
+        if (it == m_pidfds.end()) return;
+        close(it->second); // also drops it from the epoll set
+        m_pidfds.erase(it);
+    }
+
+private:
+    static int OnXError(Display* display, XErrorEvent* error) {
+        if (display == s_errorDisplay && error->error_code == BadWindow) return 0;
+        return s_previousHandler ? s_previousHandler(display, error) : 0;
+    }
+
+    Window ActiveWindow() {
+        Window active = None;
+        unsigned char* data = nullptr;
+        unsigned long count = 0;
+        if (GetProperty(m_root, m_netActiveWindow, XA_WINDOW, &data, &count) && count > 0)
+            active = (Window)*(unsigned long*)data;
+        if (data) XFree(data);
+        return active;
+    }
+
+    // Moves the title watch to the new active window, then tells the tracker
+    bool Activate(ContextTracker& tracker, Window window) {
+        if (window == m_active) return false;
+        if (m_active != None) XSelectInput(m_display, m_active, NoEventMask);
+        m_active = window;
+        if (window == None) return false;
+        XSelectInput(m_display, window, PropertyChangeMask);
+        return tracker.OnForeground((WindowId)window);
+    }
+
+    bool GetProperty(Window window, Atom property, Atom type, unsigned char** data, unsigned long* count) {
+        Atom actualType;
+        int format;
+        unsigned long after;
+        *data = nullptr;
+        if (XGetWindowProperty(m_display, window, property, 0, 1024, False, type,
+                               &actualType, &format, count, &after, data) != Success)
+            return false;
+        return *data && actualType == type;
+    }
+
+    static std::wstring FromUtf8(const std::string& s) {
+        std::wstring out;
+        for (size_t i = 0; i < s.size();) {
+            unsigned char c = (unsigned char)s[i];
+            int len = c < 0x80 ? 1 : (c >> 5) == 6 ? 2 : (c >> 4) == 14 ? 3 : (c >> 3) == 30 ? 4 : 0;
+            if (!len || i + len > s.size()) { out += L'\xFFFD'; i++; continue; }
+            unsigned long cp = len == 1 ? c : c & (0x7F >> len);
+            for (int k = 1; k < len; k++) cp = (cp << 6) | ((unsigned char)s[i + k] & 0x3F);
+            out += (wchar_t)cp; // wchar_t is 32-bit on Linux
+            i += len;
+        }
+        return out;
+    }
+
+    inline static Display* s_errorDisplay = nullptr;
+    inline static XErrorHandler s_previousHandler = nullptr;
+
+    Display* m_display = nullptr;
+    Window m_root = None;
+    Window m_active = None;
+    bool m_started = false;
+    int m_events = -1; // epoll: the X connection plus one pidfd per watched process
+    std::unordered_map<std::uint32_t, int> m_pidfds;
+    Atom m_netActiveWindow = None, m_netWmName = None, m_netWmPid = None, m_utf8String = None;
+};
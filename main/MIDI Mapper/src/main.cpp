@@ -13,9 +13,24 @@
 #include <mutex>
 #include <memory>
 #include <algorithm>
+#include <array>
 #include <functional>
 #include <queue>
+#include <atomic>
+#include <bitset>
+#include <deque>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <cmath>
+#include <cstdint>
+#include <climits>
+#include <string_view>
+#include <regex>
+#include <bit>
 #include "RtMidi.h"
+#include "ForegroundContext.h"
+#include "FileIO.h"
 
 // WebView2
 #include <wrl.h>
@@ -59,14 +74,24 @@ using json = nlohmann::json;
 #define PIANO_TOTAL_KEYS 128
 #define PIANO_DECAY_TIMER 503
 #define PIANO_DECAY_MS 50
-#define CHORD_TIMER_ID 504
 #define CHORD_THRESHOLD_MS 60 // Window to group notes into a chord
-#define WM_CHORD_SIGNAL (WM_USER + 201)
 #define WM_LEARN_MIDI_SIGNAL (WM_USER + 202)
 #define WM_UI_BRIDGE_SIGNAL (WM_USER + 203)
-#define GESTURE_TIMER_ID 505
+#define WM_PROFILE_RELOADED (WM_USER + 204)
+#define WM_PROCESS_EXITED (WM_USER + 205) // wParam: pid
+#define GESTURE_TIMER_ID 0x10000 // one timer id per note slot
 #define GESTURE_WINDOW_MS 300
 #define LONG_HOLD_MS 800
+#define FEEDBACK_TIMER_ID 700
+#define TITLE_TIMER_ID 701
+#define TITLE_DEBOUNCE_MS 150
+#define FEEDBACK_INTERVAL_MS 30
+#define FEEDBACK_MAX_PER_TICK 32 // ~1000 msgs/s, roughly the DIN MIDI wire rate
+#define FEEDBACK_SLOTS (2 * 16 * 128) // [note|cc][channel][number]
+#define MAX_MIDI_DEVICES 16
+#define NOTE_SLOTS (MAX_MIDI_DEVICES * 16 * 128) // [device][channel][number]
+#define DISPATCH_KEYS (NOTE_SLOTS * 2)           // [device][channel][note|cc][number]
+#define MAX_LAYERS 16
 
 // ── Global State ──
 HINSTANCE g_hInst;
@@ -74,17 +99,19 @@ HWND g_hwndMain = nullptr;
 wil::com_ptr<ICoreWebView2> g_webview;
 wil::com_ptr<ICoreWebView2Controller> g_controller;
 
-std::unique_ptr<RtMidiIn> g_midiIn;
 std::vector<std::string> g_ports;
-bool g_connected = false;
-int g_lastConnectedPort = -1;
-std::string g_lastConnectedPortName;
+bool g_connected = false; // at least one input device is open
+std::vector<std::string> g_lastConnectedPortNames;
+RtMidi::Api g_midiApi = RtMidi::UNSPECIFIED; // backend override from config ("midi_api")
+// Outputs: rawmidi is input-only, so an "alsaraw" override leaves them on the default search
+inline RtMidi::Api OutputApi() { return g_midiApi == RtMidi::LINUX_ALSA_RAW ? RtMidi::UNSPECIFIED : g_midiApi; }
 
 // ── Mapping struct ──
 struct Mapping {
-    int midi_type;      // 0=Note, 1=CC, 2=Chord, 3=LayerKey, 4=Macro, 5=AI
-    int midi_num;       // for Note/CC/LayerKey/Macro/AI
-    std::vector<int> midi_chord; // for Chord
+    int midi_type;      // 0=Note, 1=CC, 2=Chord, 3=LayerKey, 4=Macro, 5=AI, 6=MPE Expression, 7=NRPN, 8=RPN,
+                        // 9=Pitch Bend, 10=Channel Pressure, 11=Poly Aftertouch, 12=Program Change, 13=Sequence
+    int midi_num;       // for Note/CC/LayerKey/Macro/AI/Poly AT/Program; MPE: 0=Bend, 1=Pressure, 2=Timbre (CC74); NRPN/RPN: 14-bit parameter
+    std::vector<int> midi_chord; // for Chord; Sequence: the notes in playing order
     int key_vk;
     int modifiers;      // bitmask: 1=Ctrl, 2=Shift, 4=Alt
     int vel_min;
@@ -96,6 +123,19 @@ struct Mapping {
     std::string title_pattern; // for Context Filter
     std::string app_pattern;   // for Process Filter (e.g. chrome.exe)
     int gesture_id;     // 0=Single/Any, 1=Double Tap, 2=Long Hold
+    int channel = -1;   // -1=any, 0-15=MIDI channel
+    int device = -1;    // -1=any, else index into g_deviceNames
+    int cc_mode = 0;    // motion CCs: 0=Step per message (centre 64), 1=Relative 2's complement, 2=Relative offset-64,
+                        // 3=Absolute rate (centre 64, joystick)
+    bool cc14 = false;  // CC 0-31: pair with LSB CC (n+32) and fire once per 14-bit value
+    int layers = 1;     // bit n: the mapping is on layer n (layer 0 is the base layer)
+    int layer_target = 1; // LayerKey: layer it activates
+    int layer_mode = 0;   // LayerKey: 0=momentary, 1=toggle, 2=one-shot
+    bool layer_cc = false; // LayerKey: triggered by CC midi_num (>= 64 is pressed) instead of a note
+    int seq_window = 500;  // Sequence: ms allowed from its first note to its last
+    int chord_match = 0;   // Chord: 0=exact notes, 1=pitch classes (any octave or voicing), 2=chord shape (any key)
+
+    bool operator==(const Mapping&) const = default;
 };
 
 std::vector<Mapping> g_mappings;
@@ -105,12 +145,216 @@ std::mutex g_learnMutex;
 DWORD g_learnStartTime = 0;
 Mapping g_learn_pending = { -1, -1, {}, -1, 0, 1, 0, 0, -1, "", "", "", "", 0 };
 
+// ── MIDI Devices ──
+// A device id indexes g_midiDevices directly. Ids are persisted by port name
+// in g_deviceNames so mappings keep pointing at the same controller.
+struct MidiDevice {
+    std::unique_ptr<RtMidiIn> in;
+    std::string portName;
+    unsigned char ccValue[16][128] = {}; // last CC values, for edge detection
+};
+MidiDevice g_midiDevices[MAX_MIDI_DEVICES];
+std::vector<std::string> g_deviceNames;
+
+// Flat index for per-note state keyed by (device, channel, number).
+inline int NoteSlot(int device, int channel, int number) {
+    return (device << 11) | (channel << 7) | number;
+}
+
+// ── Dispatch Table ──
+inline int DispatchKey(int device, int channel, int kind, int number) {
+    return (device << 12) | (channel << 8) | (kind << 7) | number;
+}
+
+// ── Chord Index ──
+// A chord as a 12-bit pitch-class set (bit n % 12), and that set rotated to
+// its smallest value, so every transposition of a chord shape is one value.
+#define CHORD_MASKS 4096
+inline unsigned int PitchClassMask(const std::vector<int>& notes) {
+    unsigned int mask = 0;
+    for (int n : notes)
+        if (n >= 0) mask |= 1u << (n % 12);
+    return mask;
+}
+
+inline unsigned int ChordShape(unsigned int mask) {
+    unsigned int shape = mask;
+    for (int r = 1; r < 12; r++)
+        shape = std::min(shape, ((mask >> r) | (mask << (12 - r))) & 0xFFF);
+    return shape;
+}
+
+// ── MPE ──
+// Zone layout from config: the lower zone's master is channel 1 with members
+// 2..(1+n), the upper zone's master is channel 16 with members counting down.
+int g_mpeLowerMembers = 0;
+int g_mpeUpperMembers = 0;
+bool g_mpeMember[16] = { false };
+struct MpeNoteState {
+    bool active = false;                 // a note is sounding on this member channel
+    int value[3] = { 8192, 0, 64 };      // last bend, pressure, timbre
+};
+MpeNoteState g_mpeNotes[MAX_MIDI_DEVICES * 16]; // [device][channel], engine thread only
+struct MpeTarget { int action; int device; };   // action: cc_action 1=Mouse X, 2=Mouse Y, 3=Scroll
+
+// ── CC Assembly ──
+// 14-bit CC pairs and (N)RPN data entry are assembled per (device, channel)
+// before dispatch, so a high-resolution control fires once per value.
+struct ParamState {
+    unsigned char ccMsb[32] = {};        // pending MSB of each 14-bit CC pair
+    int selMsb = 127, selLsb = 127;      // selected parameter (127/127 = null)
+    bool selNrpn = false;                // last selection was NRPN (99/98) rather than RPN (101/100)
+    int dataMsb = 0;                     // data entry MSB (CC 6)
+    std::map<int, int> lastValue;        // assembled values by (kind << 14 | number), for edge detection
+};
+ParamState g_paramStates[MAX_MIDI_DEVICES * 16]; // [device][channel], engine thread only
+
+// ── Key Codes ──
+// Set-1 scancodes for keys that sit in the same place on every layout, and
+// which of them need KEYEVENTF_EXTENDEDKEY. Character keys move between
+// layouts, so their scancode (0 here) is asked of the active layout instead.
+struct KeyCode {
+    WORD scan = 0;
+    bool extended = false;
+};
+constexpr std::array<KeyCode, 256> kKeyCodes = [] {
+    std::array<KeyCode, 256> t{};
+    auto set = [&t](int vk, WORD scan, bool extended = false) { t[vk] = { scan, extended }; };
+    set(VK_ESCAPE, 0x01); set(VK_BACK, 0x0E); set(VK_TAB, 0x0F); set(VK_RETURN, 0x1C);
+    set(VK_SPACE, 0x39); set(VK_CAPITAL, 0x3A); set(VK_NUMLOCK, 0x45); set(VK_SCROLL, 0x46);
+    set(VK_SHIFT, 0x2A); set(VK_LSHIFT, 0x2A); set(VK_RSHIFT, 0x36);
+    set(VK_CONTROL, 0x1D); set(VK_LCONTROL, 0x1D); set(VK_RCONTROL, 0x1D, true);
+    set(VK_MENU, 0x38); set(VK_LMENU, 0x38); set(VK_RMENU, 0x38, true);
+    set(VK_LWIN, 0x5B, true); set(VK_RWIN, 0x5C, true); set(VK_APPS, 0x5D, true);
+    for (int i = 0; i < 10; i++) set(VK_F1 + i, (WORD)(0x3B + i));
+    set(VK_F11, 0x57); set(VK_F12, 0x58);
+    set(VK_HOME, 0x47, true); set(VK_UP, 0x48, true); set(VK_PRIOR, 0x49, true);
+    set(VK_LEFT, 0x4B, true); set(VK_RIGHT, 0x4D, true);
+    set(VK_END, 0x4F, true); set(VK_DOWN, 0x50, true); set(VK_NEXT, 0x51, true);
+    set(VK_INSERT, 0x52, true); set(VK_DELETE, 0x53, true);
+    set(VK_NUMPAD7, 0x47); set(VK_NUMPAD8, 0x48); set(VK_NUMPAD9, 0x49); set(VK_SUBTRACT, 0x4A);
+    set(VK_NUMPAD4, 0x4B); set(VK_NUMPAD5, 0x4C); set(VK_NUMPAD6, 0x4D); set(VK_ADD, 0x4E);
+    set(VK_NUMPAD1, 0x4F); set(VK_NUMPAD2, 0x50); set(VK_NUMPAD3, 0x51);
+    set(VK_NUMPAD0, 0x52); set(VK_DECIMAL, 0x53); set(VK_MULTIPLY, 0x37); set(VK_DIVIDE, 0x35, true);
+    return t;
+}();
+
+// ── Key Programs ──
+// A mapping's key output, built when the profile compiles. seq holds the
+// modifier presses, the key press, the key release and the modifier releases
+// in that order, so a press, a release or a whole tap is one slice of it.
+struct KeyProgram {
+    INPUT seq[8] = {};
+    unsigned int half = 0; // length of the press slice (and of the release slice)
+};
+
+// ── Compiled Profile ──
+// A mapping list plus every table the engine derives from it, built once and
+// never modified. The engine reads whatever g_profile points at, so switching
+// profiles is a single atomic store.
+struct ContextMatcher;
+class SequenceMatcher;
+
+struct CompiledProfile {
+    std::vector<Mapping> mappings;
+    std::vector<KeyProgram> keys;                   // per mapping
+    std::shared_ptr<const ContextMatcher> contextMatcher; // every app/title filter, compiled
+    std::shared_ptr<const SequenceMatcher> sequences;     // every Sequence mapping, compiled
+    std::vector<std::wstring_view> macroWide;       // per mapping, macro text already in UTF-16
+    // Mapping indices bucketed by DispatchKey() in CSR layout: the candidates for
+    // key k are dispatchList[dispatchStart[k] .. dispatchStart[k + 1]).
+    // "Any device/channel" mappings are expanded into every bucket they match.
+    const unsigned int* dispatchStart = nullptr;    // DISPATCH_KEYS + 1 entries
+    const int* dispatchList = nullptr;
+    unsigned int dispatchCount = 0;
+    std::vector<MpeTarget> mpeTargets[3];           // per MPE dimension
+    unsigned int cc14Mask[MAX_MIDI_DEVICES * 16] = {};  // bit n: CC n pairs with n+32
+    bool paramChannel[MAX_MIDI_DEVICES * 16] = {};      // an NRPN/RPN mapping listens here
+    bool chordNote[128] = {};                       // a chord mapping uses this note
+    // Pitch-class chord mappings in CSR layout, by PitchClassMask() in the first
+    // CHORD_MASKS buckets and by ChordShape() in the next CHORD_MASKS
+    std::vector<unsigned int> chordStart;
+    std::vector<int> chordList;
+    std::vector<int> valueMappings;                 // indices of 14-bit, (N)RPN, bend, pressure and program mappings
+
+    // What the pointers above point into, whether compiled from JSON or read
+    // from a .mtp image (never a view of the file: a save must be able to replace it)
+    std::vector<unsigned int> startStorage;
+    std::vector<int> listStorage;
+    std::wstring wideStorage;
+
+    CompiledProfile() = default;
+    CompiledProfile(const CompiledProfile&) = delete;
+    CompiledProfile& operator=(const CompiledProfile&) = delete;
+};
+std::atomic<std::shared_ptr<const CompiledProfile>> g_profile;
+// Profiles bound to apps or slots, compiled when the config loads (UI thread only)
+std::map<std::wstring, std::shared_ptr<const CompiledProfile>> g_profileCache;
+
+// ── Merged Input Stream ──
+// Device callbacks append here; one engine thread consumes in arrival order.
+struct MidiEvent {
+    long long time;         // steady_clock ticks, taken under g_midiEventMutex
+    int device;
+    unsigned char bytes[3];
+};
+std::deque<MidiEvent> g_midiEvents;
+std::mutex g_midiEventMutex;
+std::condition_variable g_midiEventCv;
+std::thread g_midiEngineThread;
+bool g_midiEngineRunning = false;
+
 // ── Per-App Profile ──
 std::map<std::wstring, std::wstring> g_appProfileBindings;
-std::wstring g_currentApp;
-std::wstring g_currentWindowTitle;
 HWINEVENTHOOK g_hWinEventHook = nullptr;
 
+// The foreground window, replaced as a whole when it changes
+struct AppContext {
+    std::wstring app, title;
+    std::string appUtf8, titleUtf8; // what the mapping filters match against
+    int appId = -1, titleId = -1;   // interned by ContextTracker
+};
+std::atomic<std::shared_ptr<const AppContext>> g_context;
+
+// The active profile as seen from the current context: context filters are
+// evaluated once per profile or foreground change, never per MIDI event.
+// The dispatch CSR here is the profile's with out-of-context mappings dropped,
+// split per layer, and kept only for the keys something still listens on, so
+// a title change costs what the profile maps rather than DISPATCH_KEYS * layers.
+// A mapping on several layers is listed by index in each.
+struct ContextView {
+    std::shared_ptr<const CompiledProfile> profile;
+    std::shared_ptr<const AppContext> context;
+    std::vector<unsigned char> active;  // per mapping: its title/app filters pass
+    int layerCount = 1;
+    std::vector<int> keys;                    // dispatch keys with candidates, ascending
+    std::vector<unsigned short> keyLayers;    // per entry of keys, bit n: layer n has candidates
+    // The candidates for keys[e] on layer l are
+    // dispatchList[dispatchStart[e * layerCount + l] .. dispatchStart[e * layerCount + l + 1])
+    std::vector<unsigned int> dispatchStart;
+    std::vector<int> dispatchList;
+
+    // Index into keys, or -1 if nothing in context listens on this key
+    int Find(int key) const {
+        auto it = std::lower_bound(keys.begin(), keys.end(), key);
+        return it != keys.end() && *it == key ? (int)(it - keys.begin()) : -1;
+    }
+};
+std::atomic<std::shared_ptr<const ContextView>> g_view;
+
+// ── Layers ──
+// Layer 0 is always on; of the others, the highest active layer that maps a
+// key wins, and keys it leaves unmapped fall through to the layers below.
+struct LayerState {
+    unsigned char holds[MAX_LAYERS] = {}; // momentary keys holding each layer
+    unsigned int momentary = 0, toggled = 0, oneShot = 0;
+    unsigned int Active() const { return 1u | momentary | toggled | oneShot; }
+};
+LayerState g_layers;                          // guarded by g_mappingsMutex
+// Layer a held note or CC was pressed on, plus one (0 = not held), so its
+// release goes to the same mapping even if the layers changed meanwhile
+unsigned char g_pressLayer[DISPATCH_KEYS];    // guarded by g_mappingsMutex
+
 // ── Gesture State ──
 struct KeyState {
     DWORD lastPressTime = 0;
@@ -118,7 +362,7 @@ struct KeyState {
     bool processingGesture = false;
     bool holdTriggered = false;
 };
-std::map<int, KeyState> g_keyStates;
+KeyState g_keyStates[NOTE_SLOTS]; // indexed by NoteSlot()
 std::mutex g_gestureMutex;
 
 // ── Tray Icon ──
@@ -128,13 +372,13 @@ bool g_minimizedToTray = false;
 // ── Persistent Config ──
 std::wstring g_configPath;
 std::wstring g_lastProfilePath;
+bool g_mappingsDirty = false; // edited since g_lastProfilePath was loaded or saved (UI thread)
+std::shared_ptr<const CompiledProfile> g_fileProfile; // what g_lastProfilePath last held as far as we know
 
 // ── Piano Roll State ──
 int g_pianoVelocity[PIANO_TOTAL_KEYS] = { 0 };
-bool g_pianoPhysicalDown[PIANO_TOTAL_KEYS] = { false };
 int g_pianoCC[128] = { 0 };
 bool g_sustainActive = false;
-std::set<int> g_sustainedVKs;
 std::mutex g_sustainMutex;
 
 // ── Auto Reconnect & App Switching ──
@@ -146,8 +390,19 @@ std::string g_aiApiKey;
 std::string g_aiGlobalPrompt = "You are a desktop automation assistant. Perform the following task briefly: {prompt}";
 
 // ── Chord Collector ──
-std::vector<int> g_chordBuffer;
+// Note Ons that can start a chord wait here until CHORD_THRESHOLD_MS after the
+// last of them; every other note goes straight through. A note's Off never
+// overtakes its On: one that arrives while the On waits is held back and
+// applied right after it. Engine thread only, except that the UI may discard
+// the window (both under g_chordMutex).
+#define NOTE_IDLE 0     // nothing deferred
+#define NOTE_PENDING 1  // On waiting in the chord window
+#define NOTE_RELEASED 2 // ... and its Off has arrived: the On fires as a tap
+std::vector<int> g_chordBuffer; // NoteSlot() of each pressed note
+unsigned char g_noteStage[NOTE_SLOTS] = {};
 std::mutex g_chordMutex;
+bool g_chordWaiting = false; // a window is open (engine thread)
+std::chrono::steady_clock::time_point g_chordDeadline;
 
 // ── UI Bridge Queue (Thread Safe) ──
 std::queue<json> g_uiMessageQueue;
@@ -159,12 +414,93 @@ std::vector<std::wstring> g_profileSlots;
 // ── CC Hold State ──
 std::map<int, bool> g_ccHoldActive;
 
+// ── Held Output ──
+// Every key the engine is holding down, under the input that pressed it.
+// Releases are taken from here rather than from the current mappings, so a
+// key pressed under one profile still comes up under the next one.
+#define HELD_SUSTAINED -1 // source of keys that only the sustain pedal holds
+struct HeldKey {
+    int source;          // DispatchKey() of the note/CC, a value-source key, or HELD_SUSTAINED
+    int vk, modifiers;   // what was pressed, for matching against a new profile
+    int holdKey;         // g_ccHoldActive entry of a hold-key action, else -1
+    KeyProgram keys;
+};
+std::vector<HeldKey> g_heldKeys; // guarded by g_mappingsMutex
+
+// ── MIDI Prefilter ──
+// One bit per status byte (message type + channel) that the active profile
+// reacts to. Read lock-free by the MIDI callback, rebuilt on profile changes.
+std::atomic<unsigned long long> g_statusPrefilter[4];
+
+// ── Controller Feedback ──
+std::unique_ptr<RtMidiOut> g_midiOut;
+std::vector<std::string> g_outPorts;
+std::string g_feedbackPortName;
+int g_activeProfileSlot = -1;   // slot of the loaded profile, -1 if not from a slot
+std::atomic<bool> g_feedbackDirty{ false };
+// What the controller should show vs. what we last sent it. Main thread only.
+unsigned char g_feedbackTarget[FEEDBACK_SLOTS] = { 0 };
+unsigned char g_feedbackShadow[FEEDBACK_SLOTS] = { 0 };
+
+// ── MIDI Thru ──
+struct ThruRoute {
+    int output = 0;             // index into g_thruOutputNames
+    int device_in = -1;         // -1=any input device
+    int type = -1;              // status nibble 0x80..0xE0, 0xF0=system, -1=any
+    int channel_in = -1;        // -1=any
+    int num_min = 0, num_max = 127; // data1 range (note/CC/poly pressure)
+    int channel_out = -1;       // -1=keep
+    int transpose = 0;          // semitones, notes and poly pressure only
+    bool unmapped_only = false; // swallow messages that drive a mapping
+};
+// Immutable snapshot read by the MIDI thread; rebuilt and swapped on changes.
+struct ThruGraph {
+    std::vector<std::string> outputNames;
+    std::vector<std::shared_ptr<RtMidiOut>> outputs; // null if the port failed to open
+    // One per output, kept with the port across snapshots: every open input's
+    // RtMidi thread forwards here, and a port must not send on two at once
+    std::vector<std::shared_ptr<std::mutex>> sendLocks;
+    std::vector<ThruRoute> routes;
+    std::bitset<MAX_MIDI_DEVICES * 4 * 16 * 128> mapped; // [device][note|cc|poly AT][channel][number] owned by a mapping
+    std::bitset<MAX_MIDI_DEVICES * 8 * 16> mappedStatus; // [device][status >> 4 & 7][channel]: program, pressure, bend
+};
+std::vector<std::string> g_thruOutputNames;
+std::vector<ThruRoute> g_thruRoutes;
+std::atomic<std::shared_ptr<const ThruGraph>> g_thruGraph;
+
+// ── Motion Engine ──
+// CC-driven pointer motion accumulates here and is emitted at a fixed rate by
+// the engine thread, independent of how fast the controller transmits.
+struct MotionConfig {
+    int rateHz = 500;
+    int deadZone = 4;            // CC steps around centre treated as rest
+    float accel = 1.6f;          // response curve exponent, 1 = linear
+    float pointerSpeed = 1200.f; // px/s at full deflection
+    float scrollSpeed = 1800.f;  // wheel units/s at full deflection
+    float encoderStep = 6.f;     // px per relative encoder tick (x4 for scroll)
+};
+MotionConfig g_motion;
+struct MotionSource { int key; int axis; float rate; }; // a held absolute CC
+std::vector<MotionSource> g_motionSources;  // engine thread only
+float g_motionPending[3] = { 0, 0, 0 };     // X, Y, wheel; fractions carry over
+std::atomic<bool> g_motionReset{ false };   // drop held sources (profile/device change)
+
 // ── Hook State ──
 HHOOK g_hKeyboardHook = NULL;
 
 // ── Forward Declarations ──
 void SendMappingsToUI();
-void ResolveGesture(int midi_num, int gesture_id);
+void OnMappingsChanged();
+void OnProfileSwapped();
+std::shared_ptr<const CompiledProfile> CompileProfile(std::vector<Mapping> mappings);
+bool ReadMappings(const std::wstring& filename, std::vector<Mapping>& out, const std::atomic<bool>* cancel = nullptr);
+void UpdateProfileWatch();
+std::shared_ptr<const CompiledProfile> ReadProfileImage(const std::wstring& filename);
+std::string BuildProfileImage(const CompiledProfile& prof);
+void ResolveGesture(int slot, int gesture_id);
+std::shared_ptr<const ContextView> RebuildContextView();
+void ReconcileHeldKeys(const ContextView& next);
+void ConnectFeedback(const std::string& portName);
 LRESULT CALLBACK LowLevelKeyboardProc(int nCode, WPARAM wParam, LPARAM lParam);
 
 // ══════════════════════════════════════════
@@ -238,36 +574,50 @@ void SendStatus(const std::string& text) {
     PostToWebView({ {"type", "status"}, {"text", text} });
 }
 
+json MappingToUiJson(const Mapping& m) {
+    std::wstring targetDisplay;
+    if (m.profile_switch >= 0) {
+        targetDisplay = L"[Profile #" + std::to_wstring(m.profile_switch) + L"]";
+    } else if ((m.midi_type == 1 || (m.midi_type >= 7 && m.midi_type <= 11)) && m.cc_action > 0) {
+        const wchar_t* actions[] = { L"", L"MouseX", L"MouseY", L"Scroll", L"HoldKey" };
+        targetDisplay = actions[m.cc_action];
+        if (m.cc_action == 4) targetDisplay += L"(" + GetKeyName(m.key_vk) + L")";
+    } else {
+        targetDisplay = GetModifierString(m.modifiers) + GetKeyName(m.key_vk);
+    }
+
+    json item = {
+        {"midi_type", m.midi_type}, {"midi_num", m.midi_num},
+        {"key_vk", m.key_vk}, {"modifiers", m.modifiers},
+        {"vel_min", m.vel_min}, {"vel_zone", m.vel_zone},
+        {"cc_action", m.cc_action}, {"profile_switch", m.profile_switch},
+        {"target_display", WideToUtf8(targetDisplay)},
+        {"macro_text", m.macro_text},
+        {"ai_prompt", m.ai_prompt},
+        {"title_pattern", m.title_pattern},
+        {"app_pattern", m.app_pattern},
+        {"gesture_id", m.gesture_id},
+        {"channel", m.channel},
+        {"device", m.device},
+        {"cc_mode", m.cc_mode},
+        {"cc14", m.cc14},
+        {"layers", m.layers}
+    };
+    if (m.midi_type == 3) {
+        item["layer_target"] = m.layer_target;
+        item["layer_mode"] = m.layer_mode;
+        item["layer_cc"] = m.layer_cc;
+    }
+    if (m.midi_type == 2 || m.midi_type == 13) item["midi_chord"] = m.midi_chord;
+    if (m.midi_type == 13) item["seq_window"] = m.seq_window;
+    if (m.midi_type == 2) item["chord_match"] = m.chord_match;
+    return item;
+}
+
 void SendMappingsToUI() {
     json arr = json::array();
     std::lock_guard<std::recursive_mutex> lock(g_mappingsMutex);
-    for (const auto& m : g_mappings) {
-        std::wstring targetDisplay;
-        if (m.profile_switch >= 0) {
-            targetDisplay = L"[Profile #" + std::to_wstring(m.profile_switch) + L"]";
-        } else if (m.midi_type == 1 && m.cc_action > 0) {
-            const wchar_t* actions[] = { L"", L"MouseX", L"MouseY", L"Scroll", L"HoldKey" };
-            targetDisplay = actions[m.cc_action];
-            if (m.cc_action == 4) targetDisplay += L"(" + GetKeyName(m.key_vk) + L")";
-        } else {
-            targetDisplay = GetModifierString(m.modifiers) + GetKeyName(m.key_vk);
-        }
-
-        json item = {
-            {"midi_type", m.midi_type}, {"midi_num", m.midi_num},
-            {"key_vk", m.key_vk}, {"modifiers", m.modifiers},
-            {"vel_min", m.vel_min}, {"vel_zone", m.vel_zone},
-            {"cc_action", m.cc_action}, {"profile_switch", m.profile_switch},
-            {"target_display", WideToUtf8(targetDisplay)},
-            {"macro_text", m.macro_text},
-            {"ai_prompt", m.ai_prompt},
-            {"title_pattern", m.title_pattern},
-            {"app_pattern", m.app_pattern},
-            {"gesture_id", m.gesture_id}
-        };
-        if (m.midi_type == 2) item["midi_chord"] = m.midi_chord;
-        arr.push_back(item);
-    }
+    for (const auto& m : g_mappings) arr.push_back(MappingToUiJson(m));
     PostToWebView({ {"type", "mappings"}, {"mappings", arr} });
 }
 
@@ -276,52 +626,62 @@ void SendMappingsToUI() {
 // ══════════════════════════════════════════
 
 // ── Improved Key Simulation (Game Compatible) ──
-void SendKeyInput(int vk, bool down, int modifiers = 0) {
-    std::vector<INPUT> inputs;
-    
-    // 1. Helper to create ScanCode INPUT
-    auto CreateInput = [](int virtualKey, bool isDown) {
-        INPUT input = {};
-        input.type = INPUT_KEYBOARD;
-        UINT sc = MapVirtualKey(virtualKey, MAPVK_VK_TO_VSC);
-        input.ki.wScan = (WORD)sc;
-        input.ki.dwFlags = KEYEVENTF_SCANCODE | (isDown ? 0 : KEYEVENTF_KEYUP);
-        
-        // 2. Handle Extended Keys (Arrows, Numpad Enter, etc.)
-        if (virtualKey == VK_LEFT || virtualKey == VK_UP || virtualKey == VK_RIGHT || virtualKey == VK_DOWN ||
-            virtualKey == VK_PRIOR || virtualKey == VK_NEXT || virtualKey == VK_END || virtualKey == VK_HOME ||
-            virtualKey == VK_INSERT || virtualKey == VK_DELETE || virtualKey == VK_DIVIDE || virtualKey == VK_RMENU || 
-            virtualKey == VK_RCONTROL) {
-            input.ki.dwFlags |= KEYEVENTF_EXTENDEDKEY;
-        }
-        return input;
-    };
+// Scancode input, so games reading raw scancodes see the keys too
+static INPUT KeyInput(int vk, bool down) {
+    INPUT input = {};
+    input.type = INPUT_KEYBOARD;
+    KeyCode code = kKeyCodes[vk & 0xFF];
+    if (!code.scan) code.scan = (WORD)MapVirtualKey(vk, MAPVK_VK_TO_VSC);
+    input.ki.wScan = code.scan;
+    input.ki.dwFlags = KEYEVENTF_SCANCODE | (down ? 0 : KEYEVENTF_KEYUP) | (code.extended ? KEYEVENTF_EXTENDEDKEY : 0);
+    return input;
+}
 
-    // 3. Press Modifiers (if down)
-    if (down && modifiers > 0) {
-        if (modifiers & 1) inputs.push_back(CreateInput(VK_CONTROL, true));
-        if (modifiers & 2) inputs.push_back(CreateInput(VK_SHIFT, true));
-        if (modifiers & 4) inputs.push_back(CreateInput(VK_MENU, true)); // Alt
-    }
+KeyProgram BuildKeyProgram(int vk, int modifiers) {
+    KeyProgram k;
+    if (vk <= 0 || vk > 0xFE) return k; // no key: the program is empty
+    static const int kModifierVKs[3] = { VK_CONTROL, VK_SHIFT, VK_MENU }; // modifiers bits 1, 2, 4
+    unsigned int n = 0;
+    for (int b = 0; b < 3; b++)
+        if (modifiers & (1 << b)) k.seq[n++] = KeyInput(kModifierVKs[b], true);
+    k.seq[n++] = KeyInput(vk, true);
+    k.half = n;
+    k.seq[n++] = KeyInput(vk, false);
+    for (int b = 2; b >= 0; b--)
+        if (modifiers & (1 << b)) k.seq[n++] = KeyInput(kModifierVKs[b], false);
+    return k;
+}
 
-    // 4. Main Key
-    inputs.push_back(CreateInput(vk, down));
+// While set, key output is collected here instead of sent (see ProcessChord)
+thread_local std::vector<INPUT>* t_inputBatch = nullptr;
 
-    // 5. Release Modifiers (if up)
-    if (!down && modifiers > 0) {
-        if (modifiers & 4) inputs.push_back(CreateInput(VK_MENU, false));
-        if (modifiers & 2) inputs.push_back(CreateInput(VK_SHIFT, false));
-        if (modifiers & 1) inputs.push_back(CreateInput(VK_CONTROL, false));
-    }
+static void SendInputs(const INPUT* inputs, unsigned int count) {
+    if (t_inputBatch) t_inputBatch->insert(t_inputBatch->end(), inputs, inputs + count);
+    else if (count) SendInput(count, const_cast<INPUT*>(inputs), sizeof(INPUT));
+}
 
-    if (!inputs.empty()) {
-        SendInput((UINT)inputs.size(), inputs.data(), sizeof(INPUT));
-    }
+// Key with its modifiers: press holds them down, release lets them go
+void SendKeyProgram(const KeyProgram& k, bool down) {
+    SendInputs(down ? k.seq : k.seq + k.half, k.half);
+}
+
+// Key alone, for hold-key actions
+void SendKeyProgramHold(const KeyProgram& k, bool down) {
+    if (k.half) SendInputs(down ? k.seq + k.half - 1 : k.seq + k.half, 1);
+}
+
+// Press and release in one SendInput call
+void SendKeyProgramTap(const KeyProgram& k) {
+    SendInputs(k.seq, k.half * 2);
+}
+
+// For keys that are not tied to a compiled mapping (sustain release, UI)
+void SendKeyInput(int vk, bool down, int modifiers = 0) {
+    SendKeyProgram(BuildKeyProgram(vk, modifiers), down);
 }
 
 void SimulateKeyCombo(int vk, int modifiers) {
-    SendKeyInput(vk, true, modifiers);
-    SendKeyInput(vk, false, modifiers);
+    SendKeyProgramTap(BuildKeyProgram(vk, modifiers));
 }
 
 void SimulateHoldKey(int vk, bool down) {
@@ -344,10 +704,28 @@ void SimulateScroll(int amount) {
     input.mi.dwFlags = MOUSEEVENTF_WHEEL;
     SendInput(1, &input, sizeof(INPUT));
 }
+// Pointer and wheel motion of one engine tick in a single SendInput call
+void SimulateMotion(int dx, int dy, int wheel) {
+    INPUT inputs[2] = {};
+    UINT count = 0;
+    if (dx || dy) {
+        inputs[count].type = INPUT_MOUSE;
+        inputs[count].mi.dx = dx;
+        inputs[count].mi.dy = dy;
+        inputs[count].mi.dwFlags = MOUSEEVENTF_MOVE;
+        count++;
+    }
+    if (wheel) {
+        inputs[count].type = INPUT_MOUSE;
+        inputs[count].mi.mouseData = wheel;
+        inputs[count].mi.dwFlags = MOUSEEVENTF_WHEEL;
+        count++;
+    }
+    if (count) SendInput(count, inputs, sizeof(INPUT));
+}
 
-void SimulateText(const std::string& text) {
-    if (text.empty()) return;
-    std::wstring wtext = Utf8ToWide(text);
+void SimulateText(std::wstring_view wtext) {
+    if (wtext.empty()) return;
     std::vector<INPUT> inputs;
     for (wchar_t ch : wtext) {
         INPUT inDown = {};
@@ -363,74 +741,482 @@ void SimulateText(const std::string& text) {
     SendInput((UINT)inputs.size(), inputs.data(), sizeof(INPUT));
 }
 
+void SimulateText(const std::string& text) {
+    SimulateText(std::wstring_view(Utf8ToWide(text)));
+}
+
+// ══════════════════════════════════════════
+//  Write-Behind Persistence
+// ══════════════════════════════════════════
+
+// Saves are queued per path and written by one worker thread after a short
+// debounce; a newer save of the same path replaces the queued one. Callers
+// hand over an immutable snapshot, and rendering it (JSON dump, image build)
+// happens on the worker too.
+#define PERSIST_DEBOUNCE_MS 250
+
+struct PersistJob {
+    std::function<std::string()> render;
+    std::chrono::steady_clock::time_point due;
+};
+std::map<std::wstring, PersistJob> g_persistQueue;
+std::mutex g_persistMutex;
+std::condition_variable g_persistCv;
+std::thread g_persistThread;
+bool g_persistStopping = false;
+// Reported by get_persist_stats
+std::atomic<int> g_persistDepth{ 0 };
+std::atomic<int> g_persistLastMs{ 0 };
+std::atomic<int> g_persistMaxMs{ 0 };
+std::atomic<unsigned> g_persistWrites{ 0 };
+std::atomic<unsigned> g_persistFailures{ 0 };
+
+void PersistenceThread() {
+    std::unique_lock<std::mutex> lock(g_persistMutex);
+    while (true) {
+        if (g_persistQueue.empty()) {
+            if (g_persistStopping) break;
+            g_persistCv.wait(lock);
+            continue;
+        }
+        auto next = std::min_element(g_persistQueue.begin(), g_persistQueue.end(),
+            [](const auto& a, const auto& b) { return a.second.due < b.second.due; });
+        if (!g_persistStopping && std::chrono::steady_clock::now() < next->second.due) {
+            g_persistCv.wait_until(lock, next->second.due);
+            continue;
+        }
+        std::wstring path = next->first;
+        PersistJob job = std::move(next->second);
+        g_persistQueue.erase(next);
+        g_persistDepth = (int)g_persistQueue.size();
+        lock.unlock();
+
+        auto start = std::chrono::steady_clock::now();
+        bool ok = WriteFileAtomic(path, job.render());
+        int ms = (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        g_persistLastMs = ms;
+        if (ms > g_persistMaxMs) g_persistMaxMs = ms;
+        if (ok) g_persistWrites++;
+        else {
+            g_persistFailures++;
+            SendLog("Failed to save " + WideToUtf8(path));
+        }
+        lock.lock();
+    }
+}
+
+void QueueWrite(const std::wstring& path, std::function<std::string()> render) {
+    {
+        std::lock_guard<std::mutex> lock(g_persistMutex);
+        if (!g_persistStopping) {
+            if (!g_persistThread.joinable()) g_persistThread = std::thread(PersistenceThread);
+            // The debounce runs from the first queued save, so a steady stream
+            // of changes is still written at least every PERSIST_DEBOUNCE_MS
+            PersistJob& job = g_persistQueue[path];
+            if (!job.render) job.due = std::chrono::steady_clock::now() + std::chrono::milliseconds(PERSIST_DEBOUNCE_MS);
+            job.render = std::move(render);
+            g_persistDepth = (int)g_persistQueue.size();
+            g_persistCv.notify_one();
+            return;
+        }
+    }
+    // After shutdown began there is no worker to hand this to
+    WriteFileAtomic(path, render());
+}
+
+// Writes whatever is still queued and stops the worker (on exit)
+void StopPersistence() {
+    {
+        std::lock_guard<std::mutex> lock(g_persistMutex);
+        g_persistStopping = true;
+    }
+    g_persistCv.notify_one();
+    if (g_persistThread.joinable()) g_persistThread.join();
+}
+
 // ══════════════════════════════════════════
 //  Mapping Persistence
 // ══════════════════════════════════════════
 
-void SaveMappings(const std::wstring& filename) {
+bool IsProfileImage(const std::wstring& filename) {
+    return filename.size() > 4 && _wcsicmp(filename.c_str() + filename.size() - 4, L".mtp") == 0;
+}
+
+json MappingsToJson(const std::vector<Mapping>& mappings) {
     json j = json::array();
-    {
-        std::lock_guard<std::recursive_mutex> lock(g_mappingsMutex);
-        for (const auto& m : g_mappings) {
-            json item = {
-                {"midi_type", m.midi_type}, {"midi_num", m.midi_num},
-                {"key_vk", m.key_vk}, {"modifiers", m.modifiers},
-                {"vel_min", m.vel_min}, {"vel_zone", m.vel_zone},
-                {"cc_action", m.cc_action}, {"profile_switch", m.profile_switch}
-            };
-            if (m.midi_type == 2) item["midi_chord"] = m.midi_chord;
-            if (m.midi_type == 4) item["macro_text"] = m.macro_text;
-            if (m.midi_type == 5) item["ai_prompt"] = m.ai_prompt;
-            if (!m.title_pattern.empty()) item["title_pattern"] = m.title_pattern;
-            if (!m.app_pattern.empty()) item["app_pattern"] = m.app_pattern;
-            item["gesture_id"] = m.gesture_id;
-            j.push_back(item);
+    for (const auto& m : mappings) {
+        json item = {
+            {"midi_type", m.midi_type}, {"midi_num", m.midi_num},
+            {"key_vk", m.key_vk}, {"modifiers", m.modifiers},
+            {"vel_min", m.vel_min}, {"vel_zone", m.vel_zone},
+            {"cc_action", m.cc_action}, {"profile_switch", m.profile_switch}
+        };
+        if (m.midi_type == 2 || m.midi_type == 13) item["midi_chord"] = m.midi_chord;
+        if (m.midi_type == 13) item["seq_window"] = m.seq_window;
+        if (m.midi_type == 2 && m.chord_match) item["chord_match"] = m.chord_match;
+        if (m.midi_type == 4) item["macro_text"] = m.macro_text;
+        if (m.midi_type == 5) item["ai_prompt"] = m.ai_prompt;
+        if (!m.title_pattern.empty()) item["title_pattern"] = m.title_pattern;
+        if (!m.app_pattern.empty()) item["app_pattern"] = m.app_pattern;
+        if (m.channel >= 0) item["channel"] = m.channel;
+        if (m.device >= 0) item["device"] = m.device;
+        if (m.cc_mode != 0) item["cc_mode"] = m.cc_mode;
+        if (m.cc14) item["cc14"] = true;
+        if (m.layers != 1) item["layers"] = m.layers;
+        if (m.midi_type == 3) {
+            item["layer_target"] = m.layer_target;
+            item["layer_mode"] = m.layer_mode;
+            if (m.layer_cc) item["layer_cc"] = true;
         }
+        item["gesture_id"] = m.gesture_id;
+        j.push_back(item);
     }
-    std::ofstream f(filename);
-    if (f) f << j.dump(4);
+    return j;
 }
 
-void LoadMappings(const std::wstring& filename) {
-    std::ifstream f(filename);
-    if (!f) return;
-    json j;
-    try { f >> j; } catch (...) { return; }
+void SaveMappings(const std::wstring& filename) {
+    // The live profile is immutable, so the worker can render it whenever
+    auto live = g_profile.load();
+    if (!live) live = CompileProfile({});
+    if (IsProfileImage(filename))
+        QueueWrite(filename, [live] { return BuildProfileImage(*live); });
+    else
+        QueueWrite(filename, [live] { return MappingsToJson(live->mappings).dump(4); });
+
+    // The saved file now matches the live profile
+    auto it = g_profileCache.find(filename);
+    if (it != g_profileCache.end() && live) it->second = live;
+}
+
+// ── Streaming Profile Reader ──
+// Mapping records are filled straight from json.hpp's SAX events, so a large
+// profile never exists as a DOM. Validation happens as values arrive, and an
+// error names the line and column it was found at.
+struct JsonPosition {
+    size_t line = 1;
+    size_t column = 0;
+};
+
+// Stream iterator that counts lines and columns as the parser consumes input
+class CountingIterator {
+public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = char;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const char*;
+    using reference = char;
+
+    CountingIterator() = default;
+    CountingIterator(std::istream& in, JsonPosition& pos) : it(in), pos(&pos) {}
+    char operator*() const { return *it; }
+    CountingIterator& operator++() {
+        if (*it == '\n') { pos->line++; pos->column = 0; }
+        else pos->column++;
+        ++it;
+        return *this;
+    }
+    bool operator==(const CountingIterator& other) const { return it == other.it; }
+    bool operator!=(const CountingIterator& other) const { return !(it == other.it); }
+
+private:
+    std::istreambuf_iterator<char> it;
+    JsonPosition* pos = nullptr;
+};
+
+// Every field a profile may set, with the range the engine relies on. Both
+// loaders hold profiles to it: the JSON reader per value, the .mtp loader
+// per record.
+struct MappingField {
+    enum Kind { Int, String, Bool, Chord } kind;
+    const char* name;
+    int Mapping::* number;
+    std::string Mapping::* text;
+    bool Mapping::* flag;
+    long long min, max;
+};
+static const MappingField kMappingFields[] = {
+    { MappingField::Int, "midi_type", &Mapping::midi_type, nullptr, nullptr, 0, 13 },
+    { MappingField::Int, "midi_num", &Mapping::midi_num, nullptr, nullptr, -1, 16383 },
+    { MappingField::Int, "key_vk", &Mapping::key_vk, nullptr, nullptr, -1, 255 },
+    { MappingField::Int, "modifiers", &Mapping::modifiers, nullptr, nullptr, 0, 7 },
+    { MappingField::Int, "vel_min", &Mapping::vel_min, nullptr, nullptr, 0, 127 },
+    { MappingField::Int, "vel_zone", &Mapping::vel_zone, nullptr, nullptr, 0, 2 },
+    { MappingField::Int, "cc_action", &Mapping::cc_action, nullptr, nullptr, 0, 4 },
+    { MappingField::Int, "profile_switch", &Mapping::profile_switch, nullptr, nullptr, -1, INT_MAX },
+    { MappingField::Int, "gesture_id", &Mapping::gesture_id, nullptr, nullptr, 0, 2 },
+    { MappingField::Int, "channel", &Mapping::channel, nullptr, nullptr, -1, 15 },
+    { MappingField::Int, "device", &Mapping::device, nullptr, nullptr, -1, INT_MAX },
+    { MappingField::Int, "cc_mode", &Mapping::cc_mode, nullptr, nullptr, 0, 3 },
+    { MappingField::String, "macro_text", nullptr, &Mapping::macro_text, nullptr, 0, 0 },
+    { MappingField::String, "ai_prompt", nullptr, &Mapping::ai_prompt, nullptr, 0, 0 },
+    { MappingField::String, "title_pattern", nullptr, &Mapping::title_pattern, nullptr, 0, 0 },
+    { MappingField::String, "app_pattern", nullptr, &Mapping::app_pattern, nullptr, 0, 0 },
+    { MappingField::Bool, "cc14", nullptr, nullptr, &Mapping::cc14, 0, 0 },
+    { MappingField::Int, "layers", &Mapping::layers, nullptr, nullptr, 1, (1 << MAX_LAYERS) - 1 },
+    { MappingField::Int, "layer_target", &Mapping::layer_target, nullptr, nullptr, 0, MAX_LAYERS - 1 },
+    { MappingField::Int, "layer_mode", &Mapping::layer_mode, nullptr, nullptr, 0, 2 },
+    { MappingField::Bool, "layer_cc", nullptr, nullptr, &Mapping::layer_cc, 0, 0 },
+    { MappingField::Int, "seq_window", &Mapping::seq_window, nullptr, nullptr, 1, 60000 },
+    { MappingField::Int, "chord_match", &Mapping::chord_match, nullptr, nullptr, 0, 2 },
+    { MappingField::Chord, "midi_chord", nullptr, nullptr, nullptr, 0, 127 },
+};
+
+// The first field of m outside its range, or nullptr
+const MappingField* MappingOutOfRange(const Mapping& m) {
+    for (const auto& f : kMappingFields) {
+        if (f.kind == MappingField::Int && (m.*(f.number) < f.min || m.*(f.number) > f.max)) return &f;
+        if (f.kind == MappingField::Chord)
+            for (int n : m.midi_chord)
+                if (n < f.min || n > f.max) return &f;
+    }
+    return nullptr;
+}
+
+class MappingSaxReader {
+public:
+    MappingSaxReader(std::vector<Mapping>& out, const JsonPosition& pos, const std::atomic<bool>* cancel)
+        : out(out), pos(pos), cancel(cancel) {}
+
+    std::string error;
+
+    bool null() { return skip || depth == 2 || Fail("unexpected null"); }
+    bool boolean(bool v) {
+        if (skip) return true;
+        const Field* f = Find();
+        if (!f) return depth == 2 || Fail("expected a mapping object");
+        if (f->kind != Field::Bool) return WrongType(*f);
+        cur.*(f->flag) = v;
+        return true;
+    }
+    bool number_integer(json::number_integer_t v) { return Integer(v); }
+    bool number_unsigned(json::number_unsigned_t v) {
+        return Integer(v > (json::number_unsigned_t)INT_MAX ? (long long)INT_MAX + 1 : (long long)v);
+    }
+    bool number_float(json::number_float_t v, const std::string&) {
+        if (skip) return true;
+        if (v != std::floor(v)) return Fail("expected a whole number");
+        return Integer(v > INT_MAX ? (long long)INT_MAX + 1 : v < INT_MIN ? (long long)INT_MIN - 1 : (long long)v);
+    }
+    bool string(std::string& v) {
+        if (skip) return true;
+        const Field* f = Find();
+        if (!f) return depth == 2 || Fail("expected a mapping object");
+        if (f->kind != Field::String) return WrongType(*f);
+        cur.*(f->text) = std::move(v);
+        return true;
+    }
+    bool binary(json::binary_t&) { return skip || Fail("unexpected binary value"); }
+
+    bool start_object(std::size_t) {
+        if (cancel && cancel->load(std::memory_order_relaxed)) return Fail("cancelled");
+        if (skip) { skip++; return true; }
+        if (depth == 1) {
+            cur = Mapping{};
+            cur.vel_min = 1;
+            cur.profile_switch = -1;
+            depth = 2;
+            return true;
+        }
+        if (depth == 2 && !Find()) { skip = 1; return true; } // unknown key, nested value
+        return Fail(depth == 0 ? "expected an array of mappings" : "unexpected object");
+    }
+    bool end_object() {
+        if (skip) { skip--; return true; }
+        out.push_back(std::move(cur));
+        depth = 1;
+        return true;
+    }
+    bool start_array(std::size_t) {
+        if (skip) { skip++; return true; }
+        if (depth == 0) { depth = 1; return true; }
+        if (depth == 2) {
+            const Field* f = Find();
+            if (!f) { skip = 1; return true; }
+            if (f->kind != Field::Chord) return WrongType(*f);
+            cur.midi_chord.clear();
+            depth = 3;
+            return true;
+        }
+        return Fail(depth == 1 ? "expected a mapping object" : "unexpected array");
+    }
+    bool end_array() {
+        if (skip) { skip--; return true; }
+        depth = (depth == 3) ? 2 : 0;
+        return true;
+    }
+    bool key(std::string& k) {
+        if (!skip) name = std::move(k);
+        return true;
+    }
+    bool parse_error(std::size_t, const std::string&, const json::exception& e) {
+        error = e.what();
+        return false;
+    }
+
+private:
+    using Field = MappingField;
+
+    const Field* Find() const {
+        if (depth != 2) return nullptr;
+        for (const auto& f : kMappingFields)
+            if (name == f.name) return &f;
+        return nullptr;
+    }
+
+    bool Integer(long long v) {
+        if (skip) return true;
+        if (depth == 3) {
+            if (v < 0 || v > 127) return Fail("midi_chord notes must be 0-127");
+            cur.midi_chord.push_back((int)v);
+            return true;
+        }
+        const Field* f = Find();
+        if (!f) return depth == 2 || Fail("expected a mapping object");
+        if (f->kind != Field::Int) return WrongType(*f);
+        if (v < f->min || v > f->max)
+            return Fail(name + " must be " + std::to_string(f->min) + " to " + std::to_string(f->max));
+        cur.*(f->number) = (int)v;
+        return true;
+    }
+
+    bool WrongType(const Field& f) {
+        static const char* kExpected[] = { "a number", "a string", "true or false", "an array of notes" };
+        return Fail(name + " must be " + kExpected[f.kind]);
+    }
+
+    bool Fail(const std::string& msg) {
+        error = "line " + std::to_string(pos.line) + ", column " + std::to_string(pos.column) + ": " + msg;
+        return false;
+    }
+
+    std::vector<Mapping>& out;
+    const JsonPosition& pos;
+    const std::atomic<bool>* cancel;
+    int depth = 0;     // 1 = top-level array, 2 = mapping object, 3 = midi_chord
+    int skip = 0;      // nesting inside the value of an unknown key
+    std::string name;  // current key
+    Mapping cur = {};
+};
+
+// Streams a JSON profile into out. cancel, if given, aborts between mappings.
+bool ReadMappings(const std::wstring& filename, std::vector<Mapping>& out, const std::atomic<bool>* cancel) {
+    std::ifstream f(filename, std::ios::binary);
+    if (!f) return false;
+    out.clear();
+    JsonPosition pos;
+    MappingSaxReader reader(out, pos, cancel);
+    if (!json::sax_parse(CountingIterator(f, pos), CountingIterator(), &reader)) {
+        SendLog("Profile not loaded (" + WideToUtf8(filename) + "): " + reader.error);
+        out.clear();
+        return false;
+    }
+    return true;
+}
+
+// Makes a compiled profile live. The engine switches with the one atomic
+// store; the editable copy and the UI follow. filename records where it came from.
+void ActivateProfile(const std::shared_ptr<const CompiledProfile>& prof, const std::wstring& filename) {
+    g_profile.store(prof);
     {
         std::lock_guard<std::recursive_mutex> lock(g_mappingsMutex);
-        g_mappings.clear();
-        for (const auto& it : j) {
-            Mapping m = {};
-            m.midi_type = it.value("midi_type", 0);
-            m.midi_num = it.value("midi_num", 0);
-            if (it.contains("midi_chord") && it["midi_chord"].is_array()) {
-                m.midi_chord = it["midi_chord"].get<std::vector<int>>();
-            }
-            m.macro_text = it.value("macro_text", "");
-            m.ai_prompt = it.value("ai_prompt", "");
-            m.title_pattern = it.value("title_pattern", "");
-            m.app_pattern = it.value("app_pattern", "");
-            m.gesture_id = it.value("gesture_id", 0);
-            m.key_vk = it.value("key_vk", 0);
-            m.modifiers = it.value("modifiers", 0);
-            m.vel_min = it.value("vel_min", 1);
-            m.vel_zone = it.value("vel_zone", 0);
-            m.cc_action = it.value("cc_action", 0);
-            m.profile_switch = it.value("profile_switch", -1);
-            g_mappings.push_back(m);
-        }
+        g_mappings = prof->mappings;
+        g_layers = {}; // a profile starts on its base layer
+        ReconcileHeldKeys(*RebuildContextView());
     }
     g_lastProfilePath = filename;
-    SendMappingsToUI();
+    g_mappingsDirty = false;
+    g_fileProfile = prof;
+    g_activeProfileSlot = -1;
+    for (size_t i = 0; i < g_profileSlots.size(); ++i)
+        if (g_profileSlots[i] == filename) g_activeProfileSlot = (int)i;
+    OnProfileSwapped();
+    UpdateProfileWatch();
+}
+
+// JSON profiles are parsed and compiled; .mtp images are read and validated
+std::shared_ptr<const CompiledProfile> LoadCompiledProfile(const std::wstring& filename, const std::atomic<bool>* cancel = nullptr) {
+    if (IsProfileImage(filename)) return ReadProfileImage(filename);
+    std::vector<Mapping> mappings;
+    if (!ReadMappings(filename, mappings, cancel)) return nullptr;
+    return CompileProfile(std::move(mappings));
+}
+
+void LoadMappings(const std::wstring& filename) {
+    auto prof = LoadCompiledProfile(filename);
+    if (!prof) return;
+    auto it = g_profileCache.find(filename);
+    if (it != g_profileCache.end()) it->second = prof; // an explicit load refreshes the cache
+    ActivateProfile(prof, filename);
+}
+
+// Slot and per-app switches: no file I/O or parsing unless the profile
+// could not be compiled up front.
+void SwitchProfile(const std::wstring& filename) {
+    auto it = g_profileCache.find(filename);
+    if (it == g_profileCache.end()) LoadMappings(filename);
+    else ActivateProfile(it->second, filename);
+}
+
+void PrecompileProfiles() {
+    g_profileCache.clear();
+    auto add = [](const std::wstring& filename) {
+        if (filename.empty() || g_profileCache.count(filename)) return;
+        if (auto prof = LoadCompiledProfile(filename)) g_profileCache[filename] = prof;
+    };
+    for (const auto& filename : g_profileSlots) add(filename);
+    for (const auto& [exe, filename] : g_appProfileBindings) add(filename);
+}
+
+// Converts between the JSON and .mtp forms, each side chosen by extension
+bool ConvertProfile(const std::wstring& from, const std::wstring& to) {
+    auto prof = LoadCompiledProfile(from);
+    if (!prof) return false;
+    return WriteFileAtomic(to, IsProfileImage(to) ? BuildProfileImage(*prof) : MappingsToJson(prof->mappings).dump(4));
 }
 
 // ══════════════════════════════════════════
 //  Persistent Config
 // ══════════════════════════════════════════
 
+static const std::pair<int, const char*> kThruTypeNames[] = {
+    { -1, "any" }, { 0x80, "note_off" }, { 0x90, "note" }, { 0xA0, "poly_pressure" }, { 0xB0, "cc" },
+    { 0xC0, "program" }, { 0xD0, "pressure" }, { 0xE0, "bend" }, { 0xF0, "system" },
+};
+
+std::string ThruTypeName(int type) {
+    for (const auto& [t, name] : kThruTypeNames)
+        if (t == type) return name;
+    return "any";
+}
+
+int ThruTypeFromName(const std::string& name) {
+    for (const auto& [t, n] : kThruTypeNames)
+        if (name == n) return t;
+    return -1;
+}
+
 void SaveConfig() {
     json cfg;
-    cfg["last_port"] = g_lastConnectedPortName;
+    cfg["last_ports"] = g_lastConnectedPortNames;
+    cfg["devices"] = g_deviceNames;
+    cfg["mpe"] = { {"lower_members", g_mpeLowerMembers}, {"upper_members", g_mpeUpperMembers} };
+    cfg["motion"] = {
+        {"rate_hz", g_motion.rateHz}, {"dead_zone", g_motion.deadZone}, {"accel", g_motion.accel},
+        {"pointer_speed", g_motion.pointerSpeed}, {"scroll_speed", g_motion.scrollSpeed},
+        {"encoder_step", g_motion.encoderStep}
+    };
+    if (g_midiApi != RtMidi::UNSPECIFIED)
+        cfg["midi_api"] = RtMidi::getApiName(g_midiApi);
+    cfg["feedback_port"] = g_feedbackPortName;
+    json thruRoutes = json::array();
+    for (const auto& r : g_thruRoutes) {
+        thruRoutes.push_back({
+            {"output", r.output}, {"device_in", r.device_in}, {"type", ThruTypeName(r.type)}, {"channel_in", r.channel_in},
+            {"num_min", r.num_min}, {"num_max", r.num_max}, {"channel_out", r.channel_out},
+            {"transpose", r.transpose}, {"unmapped_only", r.unmapped_only}
+        });
+    }
+    cfg["thru"] = { {"outputs", g_thruOutputNames}, {"routes", thruRoutes} };
     cfg["last_profile"] = WideToUtf8(g_lastProfilePath);
     cfg["auto_reconnect"] = g_autoReconnect;
     cfg["app_switching_enabled"] = g_appSwitchingEnabled;
@@ -446,8 +1232,8 @@ void SaveConfig() {
     cfg["ai_global_prompt"] = g_aiGlobalPrompt;
     cfg["velocity_zones_enabled"] = g_velocityZonesEnabled;
     cfg["minimize_to_tray_enabled"] = g_minimizeToTrayEnabled;
-    std::ofstream f(g_configPath);
-    if (f) f << cfg.dump(4);
+    QueueWrite(g_configPath, [cfg = std::move(cfg)] { return cfg.dump(4); });
+    UpdateProfileWatch(); // slots, bindings or the active profile may have moved
 }
 
 void LoadConfig() {
@@ -455,7 +1241,54 @@ void LoadConfig() {
     if (!f) return;
     json cfg;
     try { f >> cfg; } catch (...) { return; }
-    g_lastConnectedPortName = cfg.value("last_port", "");
+    g_lastConnectedPortNames.clear();
+    if (cfg.contains("last_ports") && cfg["last_ports"].is_array())
+        g_lastConnectedPortNames = cfg["last_ports"].get<std::vector<std::string>>();
+    else if (!cfg.value("last_port", "").empty())
+        g_lastConnectedPortNames.push_back(cfg.value("last_port", ""));
+    if (cfg.contains("devices") && cfg["devices"].is_array())
+        g_deviceNames = cfg["devices"].get<std::vector<std::string>>();
+    if (g_deviceNames.size() > MAX_MIDI_DEVICES) g_deviceNames.resize(MAX_MIDI_DEVICES);
+    if (cfg.contains("mpe") && cfg["mpe"].is_object()) {
+        g_mpeLowerMembers = std::clamp(cfg["mpe"].value("lower_members", 0), 0, 15);
+        g_mpeUpperMembers = std::clamp(cfg["mpe"].value("upper_members", 0), 0, 15 - g_mpeLowerMembers);
+    }
+    if (cfg.contains("motion") && cfg["motion"].is_object()) {
+        const json& mo = cfg["motion"];
+        g_motion.rateHz = std::clamp(mo.value("rate_hz", g_motion.rateHz), 50, 1000);
+        g_motion.deadZone = std::clamp(mo.value("dead_zone", g_motion.deadZone), 0, 32);
+        g_motion.accel = std::clamp(mo.value("accel", g_motion.accel), 0.5f, 4.0f);
+        g_motion.pointerSpeed = mo.value("pointer_speed", g_motion.pointerSpeed);
+        g_motion.scrollSpeed = mo.value("scroll_speed", g_motion.scrollSpeed);
+        g_motion.encoderStep = mo.value("encoder_step", g_motion.encoderStep);
+    }
+    for (int ch = 0; ch < 16; ch++) g_mpeMember[ch] = false;
+    for (int i = 1; i <= g_mpeLowerMembers; i++) g_mpeMember[i] = true;
+    for (int i = 1; i <= g_mpeUpperMembers; i++) g_mpeMember[15 - i] = true;
+    g_midiApi = RtMidi::getCompiledApiByName(cfg.value("midi_api", ""));
+    g_feedbackPortName = cfg.value("feedback_port", "");
+    if (cfg.contains("thru") && cfg["thru"].is_object()) {
+        const json& thru = cfg["thru"];
+        g_thruOutputNames.clear();
+        g_thruRoutes.clear();
+        if (thru.contains("outputs") && thru["outputs"].is_array())
+            for (const auto& o : thru["outputs"]) g_thruOutputNames.push_back(o.get<std::string>());
+        if (thru.contains("routes") && thru["routes"].is_array()) {
+            for (const auto& it : thru["routes"]) {
+                ThruRoute r;
+                r.output = it.value("output", 0);
+                r.device_in = it.value("device_in", -1);
+                r.type = ThruTypeFromName(it.value("type", "any"));
+                r.channel_in = it.value("channel_in", -1);
+                r.num_min = it.value("num_min", 0);
+                r.num_max = it.value("num_max", 127);
+                r.channel_out = it.value("channel_out", -1);
+                r.transpose = it.value("transpose", 0);
+                r.unmapped_only = it.value("unmapped_only", false);
+                g_thruRoutes.push_back(r);
+            }
+        }
+    }
     g_lastProfilePath = Utf8ToWide(cfg.value("last_profile", ""));
     g_autoReconnect = cfg.value("auto_reconnect", true);
     g_appSwitchingEnabled = cfg.value("app_switching_enabled", true);
@@ -505,22 +1338,1373 @@ void RestoreFromTray(HWND hwnd) {
     g_minimizedToTray = false;
 }
 
-// ══════════════════════════════════════════
-//  MIDI Callback
-// ══════════════════════════════════════════
-
-void ProcessMIDIEvent(int type, int number, int velocity);
+// ══════════════════════════════════════════
+//  Context Matcher
+// ══════════════════════════════════════════
+
+// All app or all title patterns of a profile, matched against one string in
+// a single pass. Pattern forms:
+//   re:<expr>  ECMAScript regex, found anywhere in the string
+//   a*b?c      glob (* and ?), matching the whole string
+//   text       plain substring, as before
+// Literals share one Aho-Corasick automaton; globs and regexes are compiled
+// once. Matching runs per foreground change, never per MIDI event.
+class PatternSet {
+public:
+    // Returns the pattern's id; equal patterns share one. pattern is not empty.
+    int Add(const std::string& pattern) {
+        auto [it, fresh] = m_ids.try_emplace(pattern, (int)m_ids.size());
+        if (!fresh) return it->second;
+        int id = it->second;
+        if (pattern.compare(0, 3, "re:") == 0) {
+            AddRegex(id, pattern.substr(3), std::regex::ECMAScript, false);
+        } else if (pattern.find_first_of("*?") != std::string::npos) {
+            std::string expr;
+            for (char c : pattern) {
+                if (c == '*') expr += ".*";
+                else if (c == '?') expr += '.';
+                else if (strchr("\\^$.|+()[]{}", c)) { expr += '\\'; expr += c; }
+                else expr += c;
+            }
+            AddRegex(id, expr, std::regex::ECMAScript, true);
+        } else {
+            AddLiteral(id, pattern);
+        }
+        return id;
+    }
+
+    // Builds the failure links; call once all patterns are added
+    void Compile() {
+        std::deque<int> queue;
+        for (auto& [c, child] : m_nodes[0].next) queue.push_back(child);
+        while (!queue.empty()) {
+            int n = queue.front();
+            queue.pop_front();
+            for (auto& [c, child] : m_nodes[n].next) {
+                int f = m_nodes[n].fail;
+                while (f && !m_nodes[f].next.count(c)) f = m_nodes[f].fail;
+                auto it = m_nodes[f].next.find(c);
+                int fail = (it != m_nodes[f].next.end()) ? it->second : 0;
+                m_nodes[child].fail = fail;
+                m_nodes[child].dict = m_nodes[fail].pattern >= 0 ? fail : m_nodes[fail].dict;
+                queue.push_back(child);
+            }
+        }
+    }
+
+    // hits[id] is set for every pattern found in text
+    void Match(std::string_view text, std::vector<unsigned char>& hits) const {
+        hits.assign(m_ids.size(), 0);
+        int n = 0;
+        for (unsigned char c : text) {
+            while (true) {
+                auto it = m_nodes[n].next.find(c);
+                if (it != m_nodes[n].next.end()) { n = it->second; break; }
+                if (!n) break;
+                n = m_nodes[n].fail;
+            }
+            // Report this node and its suffixes; a reported pattern's suffixes already were
+            for (int d = m_nodes[n].pattern >= 0 ? n : m_nodes[n].dict; d > 0; d = m_nodes[d].dict) {
+                if (hits[m_nodes[d].pattern]) break;
+                hits[m_nodes[d].pattern] = 1;
+            }
+        }
+        if (m_regexes.empty()) return;
+        std::string s(text);
+        for (const auto& r : m_regexes) {
+            if (r.whole ? std::regex_match(s, r.re) : std::regex_search(s, r.re)) hits[r.id] = 1;
+        }
+    }
+
+    size_t Size() const { return m_ids.size(); }
+
+private:
+    struct Node {
+        std::map<unsigned char, int> next;
+        int fail = 0;
+        int dict = 0;     // nearest suffix node that ends a pattern (0 = none)
+        int pattern = -1; // id of the pattern ending here
+    };
+    struct Regex {
+        int id;
+        std::regex re;
+        bool whole;
+    };
+
+    void AddLiteral(int id, const std::string& text) {
+        int n = 0;
+        for (unsigned char c : text) {
+            auto it = m_nodes[n].next.find(c);
+            if (it == m_nodes[n].next.end()) {
+                m_nodes.emplace_back();
+                it = m_nodes[n].next.emplace(c, (int)m_nodes.size() - 1).first;
+            }
+            n = it->second;
+        }
+        m_nodes[n].pattern = id;
+    }
+
+    void AddRegex(int id, const std::string& expr, std::regex::flag_type flags, bool whole) {
+        try {
+            m_regexes.push_back({ id, std::regex(expr, flags | std::regex::optimize), whole });
+        } catch (const std::regex_error& e) {
+            SendLog("Context pattern ignored (" + expr + "): " + e.what()); // never matches
+        }
+    }
+
+    std::map<std::string, int> m_ids;
+    std::vector<Node> m_nodes = std::vector<Node>(1); // node 0 is the root
+    std::vector<Regex> m_regexes;
+};
+
+// Compiled context filters of one profile: a pattern id per mapping, or -1
+// where the mapping has no filter of that kind
+struct ContextMatcher {
+    PatternSet apps, titles;
+    std::vector<int> appId, titleId;
+
+    explicit ContextMatcher(const std::vector<Mapping>& mappings) {
+        for (const auto& m : mappings) {
+            appId.push_back(m.app_pattern.empty() ? -1 : apps.Add(m.app_pattern));
+            titleId.push_back(m.title_pattern.empty() ? -1 : titles.Add(m.title_pattern));
+        }
+        apps.Compile();
+        titles.Compile();
+    }
+
+    // active[i]: mapping i's filters all pass for this app and title
+    void Evaluate(const std::string& app, const std::string& title, std::vector<unsigned char>& active) const {
+        std::vector<unsigned char> appHits, titleHits;
+        apps.Match(app, appHits);
+        titles.Match(title, titleHits);
+        active.resize(appId.size());
+        for (size_t i = 0; i < appId.size(); i++)
+            active[i] = (appId[i] < 0 || appHits[appId[i]]) && (titleId[i] < 0 || titleHits[titleId[i]]);
+    }
+};
+
+// ══════════════════════════════════════════
+//  Sequence Matcher
+// ══════════════════════════════════════════
+
+// Every Sequence mapping of a profile in one Aho-Corasick automaton over note
+// numbers. Failure links are folded into a dense transition table when it is
+// built, so a note is one table step however many sequences are mapped.
+// A state waits for its next note at most as long as the longest window of
+// the sequences running through it; past that, the run falls back along
+// failure links to the longest suffix still in time. A mapping's own window,
+// first note to last, is checked against the note times when it completes.
+#define SEQ_MAX_NOTES 16 // longer sequences are not compiled
+
+// Where the played notes stand in one profile's automaton
+struct SequenceRun {
+    std::shared_ptr<const SequenceMatcher> matcher; // the run starts over when this changes
+    int state = 0;
+    long long last = 0;                  // ms of the latest note
+    unsigned int count = 0;              // notes seen, indexing times as a ring
+    long long times[SEQ_MAX_NOTES] = {};
+};
+
+class SequenceMatcher {
+public:
+    explicit SequenceMatcher(const std::vector<Mapping>& mappings) {
+        NewState(); // root
+        for (int i = 0; i < (int)mappings.size(); i++) {
+            const Mapping& m = mappings[i];
+            if (m.midi_type != 13 || m.midi_chord.empty() || m.midi_chord.size() > SEQ_MAX_NOTES) continue;
+            if (!std::all_of(m.midi_chord.begin(), m.midi_chord.end(), [](int n) { return n >= 0 && n < 128; })) continue;
+            int s = 0;
+            for (int n : m.midi_chord) {
+                m_timeout[s] = std::max(m_timeout[s], m.seq_window);
+                if (!m_next[s * 128 + n]) {
+                    int fresh = NewState();
+                    m_next[s * 128 + n] = fresh;
+                }
+                s = m_next[s * 128 + n];
+            }
+            m_ends[s].push_back({ i, (unsigned int)m.midi_chord.size(), m.seq_window });
+        }
+
+        // Breadth first, so a state's failure target is always finished first
+        std::vector<int> queue;
+        for (int n = 0; n < 128; n++)
+            if (m_next[n]) queue.push_back(m_next[n]);
+        for (size_t q = 0; q < queue.size(); q++) {
+            int s = queue[q];
+            int f = m_fail[s];
+            m_dict[s] = m_ends[f].empty() ? m_dict[f] : f;
+            for (int n = 0; n < 128; n++) {
+                int& t = m_next[s * 128 + n];
+                if (t) {
+                    m_fail[t] = m_next[f * 128 + n];
+                    queue.push_back(t);
+                } else {
+                    t = m_next[f * 128 + n];
+                }
+            }
+        }
+    }
+
+    bool Empty() const { return m_fail.size() == 1; }
+
+    // A note struck at t (ms). Appends the mappings it completes to fired.
+    void Advance(SequenceRun& run, int note, long long t, std::vector<int>& fired) const {
+        while (run.state && t - run.last > m_timeout[run.state]) run.state = m_fail[run.state];
+        run.state = m_next[run.state * 128 + note];
+        run.last = t;
+        run.times[run.count++ % SEQ_MAX_NOTES] = t;
+        for (int s = m_ends[run.state].empty() ? m_dict[run.state] : run.state; s > 0; s = m_dict[s])
+            for (const End& e : m_ends[s])
+                if (t - run.times[(run.count - e.length) % SEQ_MAX_NOTES] <= e.window) fired.push_back(e.mapping);
+    }
+
+private:
+    struct End {
+        int mapping;
+        unsigned int length;
+        int window;
+    };
+
+    int NewState() {
+        m_next.resize(m_next.size() + 128, 0);
+        m_fail.push_back(0);
+        m_dict.push_back(-1);
+        m_timeout.push_back(0);
+        m_ends.emplace_back();
+        return (int)m_fail.size() - 1;
+    }
+
+    std::vector<int> m_next;     // state * 128 + note
+    std::vector<int> m_fail;     // longest proper suffix that is also a state
+    std::vector<int> m_dict;     // nearest state on the failure chain where a sequence ends, or -1
+    std::vector<int> m_timeout;  // ms a state waits for its next note
+    std::vector<std::vector<End>> m_ends; // sequences completed on reaching a state
+};
+// One run per (device, channel), so two players or parts interleaving their
+// notes don't break each other's sequences (engine thread)
+SequenceRun g_sequenceRuns[MAX_MIDI_DEVICES * 16];
+
+// ══════════════════════════════════════════
+//  MIDI Thru / Routing
+// ══════════════════════════════════════════
+
+void ApplySystemIgnores();
+
+// Opens (or reuses from the current snapshot) every configured output, marks
+// which note/CC slots the profile consumes, and publishes a new snapshot.
+// Runs on the main thread; the MIDI thread only ever loads the snapshot.
+void RebuildThruGraph() {
+    auto current = g_thruGraph.load();
+    auto graph = std::make_shared<ThruGraph>();
+    graph->outputNames = g_thruOutputNames;
+
+    for (const auto& name : g_thruOutputNames) {
+        std::shared_ptr<RtMidiOut> port;
+        std::shared_ptr<std::mutex> sendLock;
+        if (current) {
+            for (size_t i = 0; i < current->outputNames.size(); ++i)
+                if (current->outputNames[i] == name && current->outputs[i]) {
+                    port = current->outputs[i];
+                    sendLock = current->sendLocks[i];
+                }
+        }
+        if (!port) {
+            try {
+                port = std::make_shared<RtMidiOut>(OutputApi(), "MIDITypist");
+                unsigned int n = port->getPortCount();
+                for (unsigned int i = 0; i < n; ++i) {
+                    if (port->getPortName(i) == name) { port->openPort(i, name); break; }
+                }
+                if (!port->isPortOpen()) {
+                    RtMidi::Api api = port->getCurrentApi();
+                    if (api == RtMidi::WINDOWS_MM || api == RtMidi::WINDOWS_UWP) {
+                        // No virtual ports here; route into a loopback driver port instead
+                        SendLog("Thru output not found: " + name);
+                        port.reset();
+                    } else {
+                        port->openVirtualPort(name);
+                    }
+                }
+            }
+            catch (RtMidiError& e) {
+                SendLog("Thru output failed: " + name + " (" + std::string(e.getMessage()) + ")");
+                port.reset();
+            }
+        }
+        graph->outputs.push_back(port);
+        graph->sendLocks.push_back(sendLock ? sendLock : std::make_shared<std::mutex>());
+    }
+
+    for (const auto& r : g_thruRoutes)
+        if (r.output >= 0 && r.output < (int)graph->outputs.size()) graph->routes.push_back(r);
+
+    {
+        std::lock_guard<std::recursive_mutex> lock(g_mappingsMutex);
+        auto mark = [&graph](int device, int kind, int channel, int number) {
+            if (number < 0 || number > 127) return;
+            for (int dev = 0; dev < MAX_MIDI_DEVICES; dev++) {
+                if (device >= 0 && dev != device) continue;
+                for (int ch = 0; ch < 16; ch++)
+                    if (channel < 0 || ch == channel) graph->mapped.set((dev << 13) | (kind << 11) | (ch << 7) | number);
+            }
+        };
+        // Value sources that take the whole status, whatever the data bytes
+        auto markStatus = [&graph](int device, int type, int channel) {
+            for (int dev = 0; dev < MAX_MIDI_DEVICES; dev++) {
+                if (device >= 0 && dev != device) continue;
+                for (int ch = 0; ch < 16; ch++)
+                    if (channel < 0 || ch == channel) graph->mappedStatus.set((dev << 7) | (((type >> 4) & 7) << 4) | ch);
+            }
+        };
+        for (const auto& m : g_mappings) {
+            switch (m.midi_type) {
+            case 1:
+                mark(m.device, 1, m.channel, m.midi_num);
+                if (m.cc14 && m.midi_num < 32) mark(m.device, 1, m.channel, m.midi_num + 32);
+                break;
+            case 2: case 13:
+                for (int n : m.midi_chord) mark(m.device, 0, m.channel, n);
+                break;
+            case 7: case 8: // (N)RPN select and data entry
+                for (int cc : { 6, 38, 96, 97, 98, 99, 100, 101 }) mark(m.device, 1, m.channel, cc);
+                break;
+            case 0: case 3: case 4: case 5: // note-keyed
+                mark(m.device, (m.midi_type == 3 && m.layer_cc) ? 1 : 0, m.channel, m.midi_num);
+                break;
+            case 9: markStatus(m.device, 0xE0, m.channel); break;
+            case 10: markStatus(m.device, 0xD0, m.channel); break;
+            case 11: mark(m.device, 2, m.channel, m.midi_num); break;
+            case 12: markStatus(m.device, 0xC0, m.channel); break;
+            }
+        }
+    }
+
+    g_thruGraph.store(std::move(graph));
+    ApplySystemIgnores();
+}
+
+// RtMidi drops sysex, timing and active sensing by default. Inputs that feed
+// a "system" route must let them through, or there is nothing to forward.
+void ApplySystemIgnores() {
+    auto graph = g_thruGraph.load();
+    for (int id = 0; id < MAX_MIDI_DEVICES; id++) {
+        if (!g_midiDevices[id].in) continue;
+        bool system = false;
+        if (graph)
+            for (const auto& r : graph->routes)
+                if (r.type == 0xF0 && (r.device_in < 0 || r.device_in == id)) system = true;
+        g_midiDevices[id].in->ignoreTypes(!system, !system, !system);
+    }
+}
+
+// Called first thing in the MIDI callback. Never takes the mappings lock, so
+// forwarding does not wait on the engine; it only waits on other inputs
+// sending to the same output. Unmodified messages are handed to RtMidiOut
+// straight from RtMidi's buffer.
+void RouteMidiThru(const std::vector<unsigned char>& msg, int device) {
+    auto graph = g_thruGraph.load(std::memory_order_acquire);
+    if (!graph || graph->routes.empty()) return;
+
+    unsigned char status = msg[0];
+    int type = status < 0xF0 ? (status & 0xF0) : 0xF0;
+    int channel = status < 0xF0 ? (status & 0x0F) : -1;
+    bool keyed = (type >= 0x80 && type <= 0xB0) && msg.size() >= 2;
+    int kind = (type == 0xB0) ? 1 : (type == 0xA0) ? 2 : 0;
+    bool isMapped = keyed ? graph->mapped.test((device << 13) | (kind << 11) | (channel << 7) | msg[1])
+                          : type >= 0xC0 && type <= 0xE0 && graph->mappedStatus.test((device << 7) | (((type >> 4) & 7) << 4) | channel);
+
+    for (const auto& r : graph->routes) {
+        if (r.device_in >= 0 && r.device_in != device) continue;
+        if (r.type >= 0 && r.type != type) continue;
+        if (r.channel_in >= 0 && r.channel_in != channel) continue;
+        if (keyed && (msg[1] < r.num_min || msg[1] > r.num_max)) continue;
+        if (r.unmapped_only && isMapped) continue;
+        RtMidiOut* out = graph->outputs[r.output].get();
+        if (!out) continue;
+
+        std::lock_guard<std::mutex> lock(*graph->sendLocks[r.output]);
+        try {
+            bool remap = channel >= 0 && r.channel_out >= 0;
+            bool shift = r.transpose != 0 && keyed && type != 0xB0;
+            if ((!remap && !shift) || msg.size() > 3) {
+                out->sendMessage(msg.data(), msg.size());
+                continue;
+            }
+            unsigned char buf[3] = { msg[0], msg.size() > 1 ? msg[1] : (unsigned char)0, msg.size() > 2 ? msg[2] : (unsigned char)0 };
+            if (remap) buf[0] = (unsigned char)(type | r.channel_out);
+            if (shift) {
+                int note = buf[1] + r.transpose;
+                if (note < 0 || note > 127) continue;
+                buf[1] = (unsigned char)note;
+            }
+            out->sendMessage(buf, msg.size());
+        }
+        catch (RtMidiError&) {}
+    }
+}
+
+// ══════════════════════════════════════════
+//  MIDI Prefilter
+// ══════════════════════════════════════════
+
+bool PrefilterAccepts(int status) {
+    return (g_statusPrefilter[status >> 6].load(std::memory_order_relaxed) >> (status & 63)) & 1;
+}
+
+// The piano roll and CC monitor show everything played, mapped or not. What
+// the prefilter keeps from the engine is posted from here instead of from
+// ProcessMIDIEvent.
+void MonitorUnmapped(int status, int number, int value) {
+    int type = status & 0xF0;
+    number &= 127;
+    if (type == 0x80 || type == 0x90) {
+        int velocity = type == 0x90 ? value : 0;
+        g_pianoVelocity[number] = velocity;
+        PostToWebView({ {"type", "midi_note"}, {"note", number}, {"velocity", velocity} });
+    } else if (type == 0xB0) {
+        PostToWebView({ {"type", "midi_cc"}, {"cc", number}, {"value", value} });
+    }
+}
+
+// Recomputes the status bitmaps from the active profile. The engine-side
+// bitmap covers all devices; each open device additionally gets its own list
+// pushed down to RtMidi, which installs it as a kernel event filter where the
+// backend allows.
+void RebuildMidiPrefilter() {
+    // device < 0 collects for every device
+    auto collect = [](int device, bool withRoutes, unsigned long long* bits) {
+        auto allow = [bits](int type, int channel) {
+            for (int ch = 0; ch < 16; ch++) {
+                if (channel >= 0 && ch != channel) continue;
+                int status = type | ch;
+                bits[status >> 6] |= 1ull << (status & 63);
+            }
+        };
+
+        if (g_learning) {
+            // Learning must see every note and CC, mapped or not
+            allow(0x80, -1); allow(0x90, -1); allow(0xB0, -1);
+        } else {
+            std::lock_guard<std::recursive_mutex> lock(g_mappingsMutex);
+            for (const auto& m : g_mappings) {
+                if (device >= 0 && m.device >= 0 && m.device != device) continue;
+                if (m.midi_type == 6) {
+                    // Per-note expression plus the notes that open and close it
+                    for (int ch = 0; ch < 16; ch++) {
+                        if (!g_mpeMember[ch]) continue;
+                        allow(0x80, ch); allow(0x90, ch); allow(0xB0, ch); allow(0xD0, ch); allow(0xE0, ch);
+                    }
+                } else if (m.midi_type == 1 || m.midi_type == 7 || m.midi_type == 8) {
+                    allow(0xB0, m.channel);
+                } else if (m.midi_type >= 9 && m.midi_type <= 12) {
+                    static const int kStatus[4] = { 0xE0, 0xD0, 0xA0, 0xC0 };
+                    allow(kStatus[m.midi_type - 9], m.channel);
+                } else {
+                    allow(0x80, m.channel);
+                    allow(0x90, m.channel);
+                    allow(0xB0, m.channel); // Sustain pedal (CC 64) holds mapped notes
+                }
+            }
+        }
+
+        // The driver must also deliver whatever a thru route forwards, even if
+        // the engine itself ignores it
+        if (!withRoutes) return;
+        if (auto graph = g_thruGraph.load()) {
+            for (const auto& r : graph->routes) {
+                if (r.device_in >= 0 && r.device_in != device) continue;
+                if (r.type == 0xF0) {
+                    for (int st = 0xF0; st <= 0xFF; st++) bits[st >> 6] |= 1ull << (st & 63);
+                } else {
+                    for (int t = 0x80; t <= 0xE0; t += 0x10)
+                        if (r.type < 0 || r.type == t) allow(t, r.channel_in);
+                }
+            }
+        }
+    };
+
+    unsigned long long engineBits[4] = {};
+    collect(-1, false, engineBits);
+    for (int i = 0; i < 4; i++)
+        g_statusPrefilter[i].store(engineBits[i], std::memory_order_relaxed);
+
+    for (int id = 0; id < MAX_MIDI_DEVICES; id++) {
+        if (!g_midiDevices[id].in) continue;
+        unsigned long long bits[4] = {};
+        collect(id, true, bits);
+        // Notes and CCs always reach the callback, for the monitor
+        for (int st = 0x80; st <= 0xBF; st++)
+            if (st < 0xA0 || st >= 0xB0) bits[st >> 6] |= 1ull << (st & 63);
+        std::vector<unsigned char> statuses;
+        for (int i = 0; i < 4; i++) {
+            for (int b = 0; b < 64; b++)
+                if ((bits[i] >> b) & 1) statuses.push_back((unsigned char)(i * 64 + b));
+        }
+        g_midiDevices[id].in->setStatusFilter(statuses);
+    }
+}
+
+// MPE targets, the value-source index, the key programs, the chord notes and
+// the context and sequence matchers, cheap to derive from the mappings
+void CollectSourceLists(CompiledProfile& prof) {
+    prof.contextMatcher = std::make_shared<const ContextMatcher>(prof.mappings);
+    prof.sequences = std::make_shared<const SequenceMatcher>(prof.mappings);
+    for (int i = 0; i < (int)prof.mappings.size(); i++) {
+        const auto& m = prof.mappings[i];
+        prof.keys.push_back(BuildKeyProgram(m.key_vk, m.modifiers));
+        if (m.midi_type == 6 && m.midi_num >= 0 && m.midi_num < 3 && m.cc_action >= 1 && m.cc_action <= 3)
+            prof.mpeTargets[m.midi_num].push_back({ m.cc_action, m.device });
+        if ((m.midi_type == 1 && m.cc14) || (m.midi_type >= 7 && m.midi_type <= 12)) prof.valueMappings.push_back(i);
+        if (m.midi_type == 2 && m.chord_match) {
+            unsigned int mask = PitchClassMask(m.midi_chord); // the chord can sound in any octave
+            for (int n = 0; n < 128; n++)
+                if ((mask >> (n % 12)) & 1) prof.chordNote[n] = true;
+        } else if (m.midi_type == 2) {
+            for (int n : m.midi_chord)
+                if (n >= 0 && n < 128) prof.chordNote[n] = true;
+        }
+    }
+
+    // Count, prefix-sum, then fill, as for the dispatch table
+    auto chordBucket = [](const Mapping& m) {
+        if (m.midi_type != 2 || !m.chord_match) return -1;
+        unsigned int mask = PitchClassMask(m.midi_chord);
+        if (std::popcount(mask) < 2) return -1;
+        return m.chord_match == 1 ? (int)mask : CHORD_MASKS + (int)ChordShape(mask);
+    };
+    prof.chordStart.assign(2 * CHORD_MASKS + 1, 0);
+    for (const auto& m : prof.mappings)
+        if (int b = chordBucket(m); b >= 0) prof.chordStart[b + 1]++;
+    for (int b = 0; b < 2 * CHORD_MASKS; b++)
+        prof.chordStart[b + 1] += prof.chordStart[b];
+    prof.chordList.assign(prof.chordStart.back(), 0);
+    std::vector<unsigned int> fill(prof.chordStart.begin(), prof.chordStart.end() - 1);
+    for (int i = 0; i < (int)prof.mappings.size(); i++)
+        if (int b = chordBucket(prof.mappings[i]); b >= 0) prof.chordList[fill[b]++] = i;
+}
+
+// Buckets every keyed mapping by (device, channel, note|cc, number) so the
+// engine only visits the mappings that can fire for an incoming message.
+std::shared_ptr<const CompiledProfile> CompileProfile(std::vector<Mapping> mappings) {
+    auto prof = std::make_shared<CompiledProfile>();
+    prof->mappings = std::move(mappings);
+    const auto& list = prof->mappings;
+    auto& start = prof->startStorage;
+    auto& entries = prof->listStorage;
+    start.assign(DISPATCH_KEYS + 1, 0);
+
+    auto forEachKey = [](const Mapping& m, auto&& fn) {
+        if (m.midi_type == 2 || m.midi_type >= 6) return; // not keyed by a single 7-bit number
+        if (m.midi_type == 1 && m.cc14) return;          // dispatched once assembled
+        if (m.midi_num < 0 || m.midi_num > 127) return;
+        int kind = (m.midi_type == 1 || (m.midi_type == 3 && m.layer_cc)) ? 1 : 0;
+        for (int dev = 0; dev < MAX_MIDI_DEVICES; dev++) {
+            if (m.device >= 0 && dev != m.device) continue;
+            for (int ch = 0; ch < 16; ch++)
+                if (m.channel < 0 || ch == m.channel) fn(DispatchKey(dev, ch, kind, m.midi_num));
+        }
+    };
+
+    // Count, prefix-sum, then fill, keeping mapping order within a bucket
+    for (const auto& m : list)
+        forEachKey(m, [&start](int key) { start[key + 1]++; });
+    for (int k = 0; k < DISPATCH_KEYS; k++)
+        start[k + 1] += start[k];
+    entries.assign(start[DISPATCH_KEYS], 0);
+    std::vector<unsigned int> fill(start.begin(), start.end() - 1);
+    for (int i = 0; i < (int)list.size(); i++)
+        forEachKey(list[i], [&fill, &entries, i](int key) { entries[fill[key]++] = i; });
+    prof->dispatchStart = start.data();
+    prof->dispatchList = entries.data();
+    prof->dispatchCount = (unsigned int)entries.size();
+
+    // Macro text converted once, into one buffer
+    std::vector<size_t> wideAt;
+    for (const auto& m : list) {
+        wideAt.push_back(prof->wideStorage.size());
+        prof->wideStorage += Utf8ToWide(m.macro_text);
+    }
+    wideAt.push_back(prof->wideStorage.size());
+    for (size_t i = 0; i < list.size(); i++)
+        prof->macroWide.emplace_back(prof->wideStorage.data() + wideAt[i], wideAt[i + 1] - wideAt[i]);
+
+    CollectSourceLists(*prof);
+    for (const auto& m : list) {
+        bool pair = m.midi_type == 1 && m.cc14 && m.midi_num >= 0 && m.midi_num < 32;
+        bool param = m.midi_type == 7 || m.midi_type == 8;
+        if (!pair && !param) continue;
+        for (int dev = 0; dev < MAX_MIDI_DEVICES; dev++) {
+            if (m.device >= 0 && dev != m.device) continue;
+            for (int ch = 0; ch < 16; ch++) {
+                if (m.channel >= 0 && ch != m.channel) continue;
+                if (pair) prof->cc14Mask[dev * 16 + ch] |= 1u << m.midi_num;
+                else prof->paramChannel[dev * 16 + ch] = true;
+            }
+        }
+    }
+    return prof;
+}
+
+// UI thread: after every profile store and every foreground change
+std::shared_ptr<const ContextView> RebuildContextView() {
+    auto prof = g_profile.load();
+    if (!prof) return nullptr;
+    auto ctx = g_context.load();
+    if (!ctx) ctx = std::make_shared<const AppContext>();
+    auto view = std::make_shared<ContextView>();
+    view->profile = prof;
+    view->context = ctx;
+    prof->contextMatcher->Evaluate(ctx->appUtf8, ctx->titleUtf8, view->active);
+
+    // Only layers some mapping is on get a slot
+    int used = 1;
+    for (const auto& m : prof->mappings) used |= m.layers;
+    int layerCount = std::bit_width((unsigned int)used);
+    view->layerCount = layerCount;
+    view->dispatchList.reserve(prof->dispatchCount);
+    for (int k = 0; k < DISPATCH_KEYS; k++) {
+        unsigned int first = prof->dispatchStart[k], last = prof->dispatchStart[k + 1];
+        unsigned int layers = 0;
+        for (unsigned int c = first; c < last; c++) {
+            int idx = prof->dispatchList[c];
+            if (view->active[idx]) layers |= (unsigned int)prof->mappings[idx].layers;
+        }
+        layers &= (1u << layerCount) - 1;
+        if (!layers) continue;
+        view->keys.push_back(k);
+        view->keyLayers.push_back((unsigned short)layers);
+        for (int layer = 0; layer < layerCount; layer++) {
+            view->dispatchStart.push_back((unsigned int)view->dispatchList.size());
+            if (!((layers >> layer) & 1)) continue;
+            for (unsigned int c = first; c < last; c++) {
+                int idx = prof->dispatchList[c];
+                if (view->active[idx] && ((prof->mappings[idx].layers >> layer) & 1)) view->dispatchList.push_back(idx);
+            }
+        }
+    }
+    view->dispatchStart.push_back((unsigned int)view->dispatchList.size());
+    g_view.store(view);
+    return view;
+}
+
+// Everything outside the engine that follows the active profile
+void OnProfileSwapped() {
+    g_motionReset = true;
+    RebuildThruGraph();
+    RebuildMidiPrefilter();
+    g_feedbackDirty = true;
+    SendMappingsToUI();
+}
+
+// g_mappings was edited: publish a fresh compile of it
+void OnMappingsChanged() {
+    g_mappingsDirty = true;
+    {
+        std::lock_guard<std::recursive_mutex> lock(g_mappingsMutex);
+        auto prof = CompileProfile(g_mappings);
+        g_profile.store(prof);
+        ReconcileHeldKeys(*RebuildContextView());
+    }
+    OnProfileSwapped();
+}
+
+// The active profile changed on disk: publish the new compile, but only
+// tell the UI about the mappings that differ. Layers stay as they are, and
+// held keys are reconciled like on any swap.
+bool ApplyProfileReload(const std::shared_ptr<const CompiledProfile>& prof) {
+    json changes = json::array();
+    bool motionChanged = false;
+    {
+        std::lock_guard<std::recursive_mutex> lock(g_mappingsMutex);
+        const auto& next = prof->mappings;
+        size_t n = std::max(g_mappings.size(), next.size());
+        for (size_t i = 0; i < n; ++i) {
+            bool had = i < g_mappings.size(), has = i < next.size();
+            if (had && has && g_mappings[i] == next[i]) continue;
+            auto isMotion = [](const Mapping& m) { return m.cc_action >= 1 && m.cc_action <= 3; };
+            if ((had && isMotion(g_mappings[i])) || (has && isMotion(next[i]))) motionChanged = true;
+            if (has) changes.push_back({ {"index", i}, {"mapping", MappingToUiJson(next[i])} });
+        }
+        if (changes.empty() && g_mappings.size() == next.size()) return false;
+        g_profile.store(prof);
+        g_mappings = next;
+        ReconcileHeldKeys(*RebuildContextView());
+        PostToWebView({ {"type", "mappings_patch"}, {"count", g_mappings.size()}, {"changes", changes} });
+    }
+    if (motionChanged) g_motionReset = true;
+    RebuildThruGraph();
+    RebuildMidiPrefilter();
+    g_feedbackDirty = true;
+    return true;
+}
+
+// ══════════════════════════════════════════
+//  Compiled Profile Image (.mtp)
+// ══════════════════════════════════════════
+
+// A versioned flat image of a CompiledProfile. The dispatch index is stored
+// ready to use, so loading is a validate-and-copy; pattern strings are interned
+// into one UTF-8 pool and macro text is stored already converted to wchar_t. Offsets are
+// from the start of the file and 8-byte aligned.
+#define MTP_MAGIC     0x3150544D // "MTP1"
+#define MTP_VERSION   3
+#define MTP_FLAG_CC14 1
+#define MTP_FLAG_LAYER_CC 2
+#define MTP_FLAG_CHORD_CLASSES 4 // chord_match 1
+#define MTP_FLAG_CHORD_SHAPE 8   // chord_match 2
+
+struct MtpHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t fileSize;
+    uint32_t charSize;              // sizeof(wchar_t) of the writer
+    uint32_t dispatchKeys;          // DISPATCH_KEYS of the writer
+    uint32_t channelSlots;          // MAX_MIDI_DEVICES * 16 of the writer
+    uint32_t mappingCount, mappingsOffset;
+    uint32_t dispatchStartOffset, dispatchListOffset, dispatchCount;
+    uint32_t cc14MaskOffset, paramChannelOffset;
+    uint32_t stringsOffset, stringsSize;
+    uint32_t wideOffset, wideSize;  // wideSize in characters
+};
+
+struct MtpMapping {
+    int32_t midi_type, midi_num, key_vk, modifiers, vel_min, vel_zone;
+    int32_t cc_action, profile_switch, gesture_id, channel, device, cc_mode;
+    int32_t layers, layer_target, layer_mode;
+    uint32_t flags;
+    uint32_t chordMask[4];             // chord notes 0-127
+    int32_t seq_window;
+    uint32_t sequenceLength;
+    uint8_t sequence[SEQ_MAX_NOTES];   // sequence notes in order
+    uint32_t title, app, ai, macro;    // string pool offsets, 0 is the empty string
+    uint32_t macroWide, macroWideLen;  // span of the wide pool
+};
+
+std::string BuildProfileImage(const CompiledProfile& prof) {
+    std::string strings(1, '\0');
+    std::map<std::string, uint32_t> interned;
+    auto intern = [&](const std::string& text) -> uint32_t {
+        if (text.empty()) return 0;
+        auto [it, added] = interned.try_emplace(text, (uint32_t)strings.size());
+        if (added) strings.append(text.c_str(), text.size() + 1);
+        return it->second;
+    };
+
+    std::wstring wide;
+    std::vector<MtpMapping> records;
+    records.reserve(prof.mappings.size());
+    for (size_t i = 0; i < prof.mappings.size(); ++i) {
+        const Mapping& m = prof.mappings[i];
+        MtpMapping r = {};
+        r.midi_type = m.midi_type;   r.midi_num = m.midi_num;
+        r.key_vk = m.key_vk;         r.modifiers = m.modifiers;
+        r.vel_min = m.vel_min;       r.vel_zone = m.vel_zone;
+        r.cc_action = m.cc_action;   r.profile_switch = m.profile_switch;
+        r.gesture_id = m.gesture_id; r.channel = m.channel;
+        r.device = m.device;         r.cc_mode = m.cc_mode;
+        r.layers = m.layers;         r.layer_target = m.layer_target;
+        r.layer_mode = m.layer_mode;
+        r.flags = (m.cc14 ? MTP_FLAG_CC14 : 0) | (m.layer_cc ? MTP_FLAG_LAYER_CC : 0) |
+                  (m.chord_match == 1 ? MTP_FLAG_CHORD_CLASSES : 0) | (m.chord_match == 2 ? MTP_FLAG_CHORD_SHAPE : 0);
+        r.seq_window = m.seq_window;
+        if (m.midi_type == 13) {
+            for (int n : m.midi_chord)
+                if (n >= 0 && n < 128 && r.sequenceLength < SEQ_MAX_NOTES) r.sequence[r.sequenceLength++] = (uint8_t)n;
+        } else {
+            for (int n : m.midi_chord)
+                if (n >= 0 && n < 128) r.chordMask[n >> 5] |= 1u << (n & 31);
+        }
+        r.title = intern(m.title_pattern);
+        r.app = intern(m.app_pattern);
+        r.ai = intern(m.ai_prompt);
+        r.macro = intern(m.macro_text);
+        r.macroWide = (uint32_t)wide.size();
+        r.macroWideLen = (uint32_t)prof.macroWide[i].size();
+        wide += prof.macroWide[i];
+        records.push_back(r);
+    }
+
+    MtpHeader h = {};
+    size_t size = 0;
+    auto place = [&size](size_t bytes) {
+        size_t at = (size + 7) & ~size_t(7);
+        size = at + bytes;
+        return (uint32_t)at;
+    };
+    place(sizeof(MtpHeader));
+    h.magic = MTP_MAGIC;
+    h.version = MTP_VERSION;
+    h.charSize = sizeof(wchar_t);
+    h.dispatchKeys = DISPATCH_KEYS;
+    h.channelSlots = MAX_MIDI_DEVICES * 16;
+    h.mappingCount = (uint32_t)records.size();
+    h.mappingsOffset = place(records.size() * sizeof(MtpMapping));
+    h.dispatchStartOffset = place((DISPATCH_KEYS + 1) * sizeof(uint32_t));
+    h.dispatchCount = prof.dispatchCount;
+    h.dispatchListOffset = place(prof.dispatchCount * sizeof(int32_t));
+    h.cc14MaskOffset = place(sizeof(prof.cc14Mask));
+    h.paramChannelOffset = place(sizeof(prof.paramChannel));
+    h.stringsSize = (uint32_t)strings.size();
+    h.stringsOffset = place(strings.size());
+    h.wideSize = (uint32_t)wide.size();
+    h.wideOffset = place(wide.size() * sizeof(wchar_t));
+    h.fileSize = (uint32_t)size;
+
+    std::string image(size, '\0');
+    memcpy(image.data(), &h, sizeof(h));
+    if (!records.empty()) memcpy(&image[h.mappingsOffset], records.data(), records.size() * sizeof(MtpMapping));
+    memcpy(&image[h.dispatchStartOffset], prof.dispatchStart, (DISPATCH_KEYS + 1) * sizeof(uint32_t));
+    if (prof.dispatchCount) memcpy(&image[h.dispatchListOffset], prof.dispatchList, prof.dispatchCount * sizeof(int32_t));
+    memcpy(&image[h.cc14MaskOffset], prof.cc14Mask, sizeof(prof.cc14Mask));
+    memcpy(&image[h.paramChannelOffset], prof.paramChannel, sizeof(prof.paramChannel));
+    memcpy(&image[h.stringsOffset], strings.data(), strings.size());
+    if (!wide.empty()) memcpy(&image[h.wideOffset], wide.data(), wide.size() * sizeof(wchar_t));
+    return image;
+}
+
+// Reads an image and validates it. The profile owns copies of everything, so
+// the file is closed on return and saving over it never finds it in use.
+std::shared_ptr<const CompiledProfile> ReadProfileImage(const std::wstring& filename) {
+    std::string bytes;
+    if (!ReadFileBytes(filename, bytes) || bytes.size() < sizeof(MtpHeader)) return nullptr;
+    const char* base = bytes.data();
+    uint64_t size = bytes.size();
+
+    const MtpHeader& h = *(const MtpHeader*)base;
+    auto fits = [size](uint32_t offset, uint64_t length) {
+        return offset % 8 == 0 && offset + length <= size;
+    };
+    if (h.magic != MTP_MAGIC || h.version != MTP_VERSION || h.fileSize != size
+        || h.charSize != sizeof(wchar_t) || h.dispatchKeys != DISPATCH_KEYS
+        || h.channelSlots != MAX_MIDI_DEVICES * 16
+        || !fits(h.mappingsOffset, (uint64_t)h.mappingCount * sizeof(MtpMapping))
+        || !fits(h.dispatchStartOffset, (DISPATCH_KEYS + 1) * sizeof(uint32_t))
+        || !fits(h.dispatchListOffset, (uint64_t)h.dispatchCount * sizeof(int32_t))
+        || !fits(h.cc14MaskOffset, sizeof(CompiledProfile::cc14Mask))
+        || !fits(h.paramChannelOffset, sizeof(CompiledProfile::paramChannel))
+        || !fits(h.stringsOffset, h.stringsSize) || h.stringsSize == 0
+        || base[h.stringsOffset + h.stringsSize - 1] != '\0'
+        || !fits(h.wideOffset, (uint64_t)h.wideSize * sizeof(wchar_t))) {
+        SendLog("Invalid compiled profile: " + WideToUtf8(filename));
+        return nullptr;
+    }
+
+    // The engine indexes with these directly, so a damaged index must not load
+    const unsigned int* start = (const unsigned int*)(base + h.dispatchStartOffset);
+    const int* entries = (const int*)(base + h.dispatchListOffset);
+    bool indexOk = start[0] == 0 && start[DISPATCH_KEYS] == h.dispatchCount;
+    for (int k = 0; indexOk && k < DISPATCH_KEYS; k++) indexOk = start[k] <= start[k + 1];
+    for (uint32_t i = 0; indexOk && i < h.dispatchCount; i++)
+        indexOk = entries[i] >= 0 && (uint32_t)entries[i] < h.mappingCount;
+    if (!indexOk) {
+        SendLog("Invalid compiled profile index: " + WideToUtf8(filename));
+        return nullptr;
+    }
+
+    auto prof = std::make_shared<CompiledProfile>();
+    prof->startStorage.assign(start, start + DISPATCH_KEYS + 1);
+    prof->listStorage.assign(entries, entries + h.dispatchCount);
+    prof->dispatchStart = prof->startStorage.data();
+    prof->dispatchList = prof->listStorage.data();
+    prof->dispatchCount = h.dispatchCount;
+    memcpy(prof->cc14Mask, base + h.cc14MaskOffset, sizeof(prof->cc14Mask));
+    memcpy(prof->paramChannel, base + h.paramChannelOffset, sizeof(prof->paramChannel));
+
+    const MtpMapping* records = (const MtpMapping*)(base + h.mappingsOffset);
+    const char* strings = base + h.stringsOffset;
+    prof->wideStorage.assign((const wchar_t*)(base + h.wideOffset), h.wideSize);
+    const wchar_t* wide = prof->wideStorage.data();
+    auto str = [&](uint32_t at) { return at < h.stringsSize ? strings + at : ""; };
+    prof->mappings.resize(h.mappingCount);
+    prof->macroWide.resize(h.mappingCount);
+    for (uint32_t i = 0; i < h.mappingCount; i++) {
+        const MtpMapping& r = records[i];
+        if ((uint64_t)r.macroWide + r.macroWideLen > h.wideSize) {
+            SendLog("Invalid compiled profile text: " + WideToUtf8(filename));
+            return nullptr;
+        }
+        Mapping& m = prof->mappings[i];
+        m.midi_type = r.midi_type;   m.midi_num = r.midi_num;
+        m.key_vk = r.key_vk;         m.modifiers = r.modifiers;
+        m.vel_min = r.vel_min;       m.vel_zone = r.vel_zone;
+        m.cc_action = r.cc_action;   m.profile_switch = r.profile_switch;
+        m.gesture_id = r.gesture_id; m.channel = r.channel;
+        m.device = r.device;         m.cc_mode = r.cc_mode;
+        m.layers = r.layers;         m.layer_target = r.layer_target;
+        m.layer_mode = r.layer_mode;
+        m.cc14 = (r.flags & MTP_FLAG_CC14) != 0;
+        m.layer_cc = (r.flags & MTP_FLAG_LAYER_CC) != 0;
+        m.chord_match = (r.flags & MTP_FLAG_CHORD_SHAPE) ? 2 : (r.flags & MTP_FLAG_CHORD_CLASSES) ? 1 : 0;
+        m.seq_window = r.seq_window;
+        if (m.midi_type == 13)
+            m.midi_chord.assign(r.sequence, r.sequence + std::min<uint32_t>(r.sequenceLength, SEQ_MAX_NOTES));
+        for (int n = 0; n < 128; n++)
+            if ((r.chordMask[n >> 5] >> (n & 31)) & 1) m.midi_chord.push_back(n);
+        m.title_pattern = str(r.title);
+        m.app_pattern = str(r.app);
+        m.ai_prompt = str(r.ai);
+        m.macro_text = str(r.macro);
+        if (const MappingField* f = MappingOutOfRange(m)) {
+            SendLog("Invalid compiled profile (" + WideToUtf8(filename) + "): mapping " + std::to_string(i + 1) +
+                    " has " + f->name + " out of range");
+            return nullptr;
+        }
+        prof->macroWide[i] = std::wstring_view(wide + r.macroWide, r.macroWideLen);
+    }
+    CollectSourceLists(*prof);
+    return prof;
+}
+
+// ══════════════════════════════════════════
+//  Motion Engine
+// ══════════════════════════════════════════
+
+// By default a CC moves once per message, by its distance from centre.
+// Absolute-rate CCs (cc_mode 3: joysticks, spring-loaded wheels) set a motion
+// rate that is applied every tick while held; relative encoders add one-off
+// displacement.
+// Everything here runs on the engine thread.
+void MotionFromCC(int axis, int mode, float value, int sourceKey) {
+    float speed = (axis == 2) ? g_motion.scrollSpeed : g_motion.pointerSpeed;
+    if (mode == 0) {
+        // One step per message, sized by the distance from centre, as profiles
+        // without a cc_mode have always behaved
+        g_motionPending[axis] += (value - 64.f) * (axis == 2 ? 20.f : 2.f);
+        return;
+    }
+    if (mode == 3) {
+        float d = value - 64.f;
+        float rate = 0.f;
+        if (std::abs(d) > g_motion.deadZone) {
+            float n = std::min(1.f, (std::abs(d) - g_motion.deadZone) / (63.f - g_motion.deadZone));
+            rate = std::copysign(std::pow(n, g_motion.accel), d) * speed;
+        }
+        auto it = std::find_if(g_motionSources.begin(), g_motionSources.end(),
+            [&](const MotionSource& src) { return src.key == sourceKey && src.axis == axis; });
+        if (rate == 0.f) {
+            if (it != g_motionSources.end()) g_motionSources.erase(it);
+        }
+        else if (it != g_motionSources.end()) it->rate = rate;
+        else g_motionSources.push_back({ sourceKey, axis, rate });
+        return;
+    }
+
+    // Relative encoders: faster spins send larger deltas, the curve amplifies them
+    // (14-bit sources arrive scaled to 0..128, so offset-64 deltas can be fractional)
+    int coarse = (int)value;
+    float delta = (mode == 1) ? (float)(coarse < 64 ? coarse : coarse - 128) : value - 64.f;
+    if (delta == 0.f) return;
+    float step = g_motion.encoderStep * (axis == 2 ? 4.f : 1.f);
+    g_motionPending[axis] += std::copysign(std::pow(std::abs(delta), g_motion.accel) * step, delta);
+}
+
+// One-off displacement from other sources (MPE expression), coalesced into the next tick
+void MotionImpulse(int axis, float amount) {
+    g_motionPending[axis] += amount;
+}
+
+bool MotionActive() {
+    if (g_motionReset.exchange(false)) g_motionSources.clear();
+    if (!g_motionSources.empty()) return true;
+    for (float p : g_motionPending)
+        if (std::abs(p) >= 1.f) return true;
+    return false;
+}
+
+void MotionTick(float dt) {
+    for (const auto& src : g_motionSources)
+        g_motionPending[src.axis] += src.rate * dt;
+    int out[3];
+    for (int a = 0; a < 3; a++) {
+        out[a] = (int)g_motionPending[a]; // truncates toward zero, remainder carries
+        g_motionPending[a] -= out[a];
+    }
+    SimulateMotion(out[0], out[1], out[2]);
+}
+
+// ══════════════════════════════════════════
+//  MIDI Callback
+// ══════════════════════════════════════════
+
+void ProcessMIDIEvent(int type, int number, int velocity, int channel = -1, int device = -1);
+void FlushChord();
+
+// Highest active layer with a mapping for this view entry (caller holds g_mappingsMutex)
+int ResolveLayer(const ContextView& view, int entry) {
+    if (entry < 0) return 0;
+    unsigned int candidates = view.keyLayers[entry] & g_layers.Active();
+    return candidates ? std::bit_width(candidates) - 1 : 0;
+}
+
+// LayerKey press or release (caller holds g_mappingsMutex)
+void ApplyLayerKey(const Mapping& m, bool down) {
+    int layer = m.layer_target;
+    unsigned int bit = 1u << layer;
+    switch (m.layer_mode) {
+    case 0: // Momentary: on while any of its keys is held
+        if (down) g_layers.holds[layer]++;
+        else if (g_layers.holds[layer]) g_layers.holds[layer]--;
+        if (g_layers.holds[layer]) g_layers.momentary |= bit;
+        else g_layers.momentary &= ~bit;
+        break;
+    case 1: // Toggle
+        if (down) g_layers.toggled ^= bit;
+        break;
+    case 2: // One-shot: on until the next mapped key fires
+        if (down) g_layers.oneShot |= bit;
+        break;
+    }
+    g_feedbackDirty = true;
+    bool active = (g_layers.Active() & bit) != 0;
+    PostToWebView({ {"type", "hud"}, {"active", active}, {"title", "Layer " + std::to_string(layer)} });
+}
+
+// Presses a mapping's key and records it. holdKey >= 0: a hold-key action,
+// pressed without modifiers. (Caller holds g_mappingsMutex.)
+void PressHeld(int source, const Mapping& m, const KeyProgram& keys, int holdKey = -1) {
+    if (holdKey >= 0) SendKeyProgramHold(keys, true);
+    else SendKeyProgram(keys, true);
+    g_heldKeys.push_back({ source, m.key_vk, holdKey >= 0 ? 0 : m.modifiers, holdKey, keys });
+}
+
+static void AppendRelease(const HeldKey& h, std::vector<INPUT>& out) {
+    const KeyProgram& k = h.keys;
+    if (h.holdKey >= 0) out.insert(out.end(), k.seq + k.half, k.seq + k.half + (k.half ? 1 : 0));
+    else out.insert(out.end(), k.seq + k.half, k.seq + 2 * k.half);
+}
+
+// Releases everything source holds, in one SendInput call. Returns whether
+// it held anything. (Caller holds g_mappingsMutex.)
+bool ReleaseHeld(int source) {
+    std::vector<INPUT> inputs;
+    auto held = std::remove_if(g_heldKeys.begin(), g_heldKeys.end(), [&](const HeldKey& h) {
+        if (h.source != source) return false;
+        AppendRelease(h, inputs);
+        if (h.holdKey >= 0) {
+            g_ccHoldActive[h.holdKey] = false;
+            g_feedbackDirty = true;
+        }
+        return true;
+    });
+    bool any = held != g_heldKeys.end();
+    g_heldKeys.erase(held, g_heldKeys.end());
+    SendInputs(inputs.data(), (unsigned int)inputs.size());
+    return any;
+}
+
+// The sustain pedal takes over what source holds (caller holds g_mappingsMutex)
+void SustainHeld(int source) {
+    for (auto& h : g_heldKeys)
+        if (h.source == source) h.source = HELD_SUSTAINED;
+}
+
+// A profile swap. A held key stays down if the next view still maps the same
+// input to the same key, in context and on the layer it was pressed on;
+// everything else comes up now, in one batch. (Caller holds g_mappingsMutex.)
+void ReconcileHeldKeys(const ContextView& next) {
+    std::vector<INPUT> inputs;
+    auto carried = [&next](const HeldKey& h) {
+        if (h.source == HELD_SUSTAINED) return true; // the pedal is still down
+        if (h.source < 0 || h.source >= DISPATCH_KEYS) return false;
+        int entry = next.Find(h.source);
+        if (entry < 0) return false;
+        int layer = g_pressLayer[h.source] ? g_pressLayer[h.source] - 1 : 0;
+        if (layer >= next.layerCount) layer = 0;
+        const unsigned int* start = &next.dispatchStart[(size_t)entry * next.layerCount + layer];
+        for (unsigned int c = start[0]; c < start[1]; c++) {
+            const Mapping& m = next.profile->mappings[next.dispatchList[c]];
+            bool hold = m.midi_type == 1 && m.cc_action == 4;
+            if (m.key_vk == h.vk && hold == (h.holdKey >= 0) && (hold || m.modifiers == h.modifiers)) return true;
+        }
+        return false;
+    };
+    auto released = std::remove_if(g_heldKeys.begin(), g_heldKeys.end(), [&](const HeldKey& h) {
+        if (carried(h)) return false;
+        AppendRelease(h, inputs);
+        if (h.holdKey >= 0) g_ccHoldActive[h.holdKey] = false;
+        return true;
+    });
+    g_heldKeys.erase(released, g_heldKeys.end());
+    if (inputs.empty()) return;
+    SendInput((UINT)inputs.size(), inputs.data(), sizeof(INPUT));
+    g_feedbackDirty = true;
+    SendLog("Profile swap released " + std::to_string(inputs.size()) + " held key events", "mapping");
+}
+
+// Runs on each device's RtMidi thread. Thru forwarding happens right here so
+// it never waits on the engine; everything else is queued for the engine
+// thread, which sees the events of all devices as one ordered stream.
+void midiCallback(double, std::vector<unsigned char>* msg, void* userData) {
+    if (msg->empty()) return;
+    int device = (int)(intptr_t)userData;
+    RouteMidiThru(*msg, device);
+    if (msg->size() < 2 || (*msg)[0] >= 0xF0) return;
+    if (!PrefilterAccepts((*msg)[0])) {
+        MonitorUnmapped((*msg)[0], (*msg)[1], msg->size() > 2 ? (*msg)[2] : 0);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(g_midiEventMutex);
+        // Stamped under the lock, so queue order is timestamp order
+        g_midiEvents.push_back({ std::chrono::steady_clock::now().time_since_epoch().count(),
+                                 device, { (*msg)[0], (*msg)[1], msg->size() > 2 ? (*msg)[2] : (unsigned char)0 } });
+    }
+    g_midiEventCv.notify_one();
+}
+
+// Runs a CC-style mapping action. Values are on the 7-bit scale; assembled
+// 14-bit sources pass value / 128 so edges and motion behave the same.
+void ApplyCCAction(const Mapping& m, const KeyProgram& keys, float value, float oldValue, int sourceKey, const std::string& source) {
+    bool crossedUp = oldValue < 64.f && value >= 64.f;
+    bool crossedDown = oldValue >= 64.f && value < 64.f;
+    int holdKey = (m.midi_type << 14) | m.midi_num;
+    switch (m.cc_action) {
+    case 0: // Keypress (Now Momentary by default for games)
+        if (crossedUp) {
+            PressHeld(sourceKey, m, keys);
+            SendLog(source + " -> Key Down: " + std::to_string(m.key_vk), "mapping");
+        } else if (crossedDown) {
+            ReleaseHeld(sourceKey); // usually already done by the caller
+        }
+        break;
+    case 1: // Mouse X
+    case 2: // Mouse Y
+    case 3: // Scroll
+        MotionFromCC(m.cc_action - 1, m.cc_mode, value, sourceKey);
+        break;
+    case 4: // Hold Key (Dedicated toggle behavior or held state)
+        if (crossedUp && !g_ccHoldActive[holdKey]) {
+            PressHeld(sourceKey, m, keys, holdKey);
+            g_ccHoldActive[holdKey] = true;
+            g_feedbackDirty = true;
+        }
+        else if (crossedDown) {
+            ReleaseHeld(sourceKey); // clears g_ccHoldActive
+        }
+        break;
+    }
+}
+
+// Dispatches a 14-bit value. kind: 0=14-bit CC (number = MSB controller),
+// 1=NRPN, 2=RPN (number = 14-bit parameter), 3=Pitch Bend, 4=Channel
+// Pressure, 5=Poly Aftertouch (number = note). Pressure is 7-bit << 7.
+void DispatchParamValue(int kind, int number, int value, int channel, int device) {
+    ParamState& ps = g_paramStates[device * 16 + channel];
+    auto [it, fresh] = ps.lastValue.try_emplace((kind << 14) | number, kind == 3 ? 8192 : 0);
+    int oldValue = it->second;
+    it->second = value;
+    if (!fresh && oldValue == value) return;
+
+    static const char* kNames[6] = { "CC14 ", "NRPN ", "RPN ", "Pitch Bend", "Pressure", "Poly AT " };
+    if (kind == 0) PostToWebView({ {"type", "midi_cc"}, {"cc", number}, {"value", value >> 7} });
+
+    int type = (kind == 0) ? 1 : kind + 6;
+    bool numbered = kind != 3 && kind != 4;
+    int sourceKey = 0x100000 + (((kind * MAX_MIDI_DEVICES + device) * 16 + channel) << 14) + number;
+    auto view = g_view.load();
+    if (!view) return;
+    const auto& prof = view->profile;
+    std::lock_guard<std::recursive_mutex> lock(g_mappingsMutex); // hold-key state
+    if (oldValue >= 64 << 7 && value < 64 << 7) ReleaseHeld(sourceKey); // whether or not a mapping still matches
+    for (int idx : prof->valueMappings) {
+        const auto& m = prof->mappings[idx];
+        if (m.midi_type != type || (kind == 0 && !m.cc14)) continue;
+        if (!(m.layers & g_layers.Active())) continue; // not keyed: any active layer
+        if (numbered && m.midi_num != number) continue;
+        if (m.channel >= 0 && m.channel != channel) continue;
+        if (m.device >= 0 && m.device != device) continue;
+        if (m.profile_switch >= 0) continue;
+
+        if (!view->active[idx]) continue; // context filters
+
+        float v = value / 128.f, old = oldValue / 128.f;
+        if ((kind == 4 || kind == 5) && m.cc_action >= 1 && m.cc_action <= 3) {
+            // Pressure rests at zero: map it onto one side of the motion centre
+            v = 64.f + v / 2.f;
+            old = 64.f + old / 2.f;
+        }
+        ApplyCCAction(m, prof->keys[idx], v, old, sourceKey, numbered ? kNames[kind] + std::to_string(number) : kNames[kind]);
+    }
+}
+
+// Pitch bend, aftertouch and program change. Bend and pressure go through
+// the same value path as CCs, so motion targets run on the fixed-rate motion
+// tick rather than one injection per message.
+void ProcessChannelMessage(int type, int channel, int device, int data1, int data2) {
+    switch (type) {
+    case 0xE0: DispatchParamValue(3, 0, data1 | (data2 << 7), channel, device); return;
+    case 0xD0: DispatchParamValue(4, 0, data1 << 7, channel, device); return;
+    case 0xA0: DispatchParamValue(5, data1, data2 << 7, channel, device); return;
+    case 0xC0: break;
+    default: return;
+    }
+
+    auto view = g_view.load();
+    if (!view) return;
+    const auto& prof = view->profile;
+    std::lock_guard<std::recursive_mutex> lock(g_mappingsMutex); // layer state
+    for (int idx : prof->valueMappings) {
+        const auto& m = prof->mappings[idx];
+        if (m.midi_type != 12 || m.midi_num != data1) continue;
+        if (!(m.layers & g_layers.Active())) continue; // not keyed: any active layer
+        if (m.channel >= 0 && m.channel != channel) continue;
+        if (m.device >= 0 && m.device != device) continue;
+        if (!view->active[idx]) continue; // context filters
+        if (m.profile_switch >= 0) {
+            // Slots are precompiled; the switch itself happens on the UI thread
+            if (m.profile_switch < (int)g_profileSlots.size())
+                PostMessage(g_hwndMain, WM_USER + 100, m.profile_switch, 0);
+            continue;
+        }
+        SendKeyProgramTap(prof->keys[idx]);
+        SendLog("Program " + std::to_string(data1) + " -> Key: " + std::to_string(m.key_vk), "mapping");
+    }
+}
+
+// Per-channel parameter state machine. 14-bit pairs fire on the LSB (a
+// controller may resend only the LSB while the MSB holds); (N)RPN fires on
+// data entry LSB (CC 38) or increment/decrement (CC 96/97). Returns true if
+// the CC was consumed; CCs nothing assembles pass through untouched.
+bool ProcessParamCC(int device, int channel, int cc, int value) {
+    int idx = device * 16 + channel;
+    auto prof = g_profile.load();
+    if (!prof) return false;
+    unsigned int mask = prof->cc14Mask[idx];
+    bool params = prof->paramChannel[idx];
+    ParamState& ps = g_paramStates[idx];
+
+    if (cc < 32 && ((mask >> cc) & 1)) {
+        ps.ccMsb[cc] = (unsigned char)value;
+        return true;
+    }
+    if (cc >= 32 && cc < 64 && ((mask >> (cc - 32)) & 1)) {
+        DispatchParamValue(0, cc - 32, (ps.ccMsb[cc - 32] << 7) | value, channel, device);
+        return true;
+    }
+    if (!params) return false;
+
+    bool selected = !(ps.selMsb == 127 && ps.selLsb == 127);
+    int param = (ps.selMsb << 7) | ps.selLsb;
+    int kind = ps.selNrpn ? 1 : 2;
+    switch (cc) {
+    case 99: ps.selNrpn = true;  ps.selMsb = value; return true;
+    case 98: ps.selNrpn = true;  ps.selLsb = value; return true;
+    case 101: ps.selNrpn = false; ps.selMsb = value; return true;
+    case 100: ps.selNrpn = false; ps.selLsb = value; return true;
+    case 6:
+        // Many senders never follow with an LSB (pitch-bend range, most
+        // NRPN controllers): act on the coarse value now, refine on CC 38
+        ps.dataMsb = value;
+        if (selected) DispatchParamValue(kind, param, value << 7, channel, device);
+        return true;
+    case 38:
+        if (selected) DispatchParamValue(kind, param, (ps.dataMsb << 7) | value, channel, device);
+        return true;
+    case 96:
+    case 97:
+        if (selected) {
+            auto it = ps.lastValue.find((kind << 14) | param);
+            int current = (it != ps.lastValue.end()) ? it->second : (ps.dataMsb << 7);
+            int next = std::clamp(current + (cc == 96 ? 1 : -1), 0, 16383);
+            ps.dataMsb = next >> 7;
+            DispatchParamValue(kind, param, next, channel, device);
+        }
+        return true;
+    }
+    return false;
+}
+
+// Per-note expression on an MPE member channel, fed to the motion engine as
+// impulses; the compiled target list makes this O(1) per event. Returns true
+// if the message was consumed.
+bool ProcessMpeExpression(int type, int channel, int device, int data1, int data2) {
+    int dim, value;
+    if (type == 0xE0) { dim = 0; value = data1 | (data2 << 7); }
+    else if (type == 0xD0) { dim = 1; value = data1; }
+    else if (type == 0xB0 && data1 == 74) { dim = 2; value = data2; }
+    else return false;
+
+    MpeNoteState& note = g_mpeNotes[device * 16 + channel];
+    int delta = value - note.value[dim];
+    note.value[dim] = value;
+    if (!note.active || delta == 0) return true;
+
+    // A full bend sweep is ~512 px; 7-bit streams move 4 px per step
+    static const float kScale[3] = { 1.f / 32.f, 4.f, 4.f };
+    float amount = delta * kScale[dim];
+
+    auto prof = g_profile.load();
+    if (!prof) return true;
+    for (const auto& t : prof->mpeTargets[dim]) {
+        if (t.device >= 0 && t.device != device) continue;
+        MotionImpulse(t.action - 1, t.action == 3 ? amount * 4.f : amount);
+    }
+    return true;
+}
+
+// Sequences: every struck note advances its (device, channel) run, mapped or
+// not, in arrival order, before the chord window regroups anything. A
+// completed sequence holds its key while the note that completed it does.
+void AdvanceSequences(int device, int channel, int number, long long time) {
+    auto view = g_view.load();
+    if (!view || view->profile->sequences->Empty()) return;
+    const auto& prof = view->profile;
+    SequenceRun& run = g_sequenceRuns[device * 16 + channel];
+    if (run.matcher != prof->sequences) run = { prof->sequences };
+    std::vector<int> fired;
+    long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::duration(time)).count();
+    prof->sequences->Advance(run, number, ms, fired);
+    if (fired.empty()) return;
+    std::lock_guard<std::recursive_mutex> lock(g_mappingsMutex);
+    for (int idx : fired) {
+        const auto& m = prof->mappings[idx];
+        if (!(m.layers & g_layers.Active())) continue; // not keyed: any active layer
+        if (m.channel >= 0 && m.channel != channel) continue;
+        if (m.device >= 0 && m.device != device) continue;
+        if (!view->active[idx]) continue; // context filters
+        PressHeld(DispatchKey(device, channel, 0, number), m, prof->keys[idx]);
+        SendLog("Sequence -> Key Down: " + std::to_string(m.key_vk), "mapping");
+    }
+}
+
+// A note off the chord window holds back still lets go of what its sequence pressed
+void ReleaseNoteHeld(int device, int channel, int number) {
+    std::lock_guard<std::recursive_mutex> lock(g_mappingsMutex);
+    std::lock_guard<std::mutex> sustainLock(g_sustainMutex);
+    int key = DispatchKey(device, channel, 0, number);
+    if (g_sustainActive) SustainHeld(key);
+    else ReleaseHeld(key);
+}
 
-void midiCallback(double, std::vector<unsigned char>* msg, void*) {
-    if (msg->size() < 3) return;
-    int status = (*msg)[0];
-    int number = (*msg)[1];
-    int velocity = (*msg)[2];
+void ProcessMidiInput(const MidiEvent& ev) {
+    int status = ev.bytes[0];
+    int channel = status & 0x0F;
+    int number = ev.bytes[1];
+    int velocity = ev.bytes[2];
+    int device = ev.device;
 
     bool isNoteOn = (status & 0xF0) == 0x90 && velocity > 0;
     bool isNoteOff = (status & 0xF0) == 0x80 || ((status & 0xF0) == 0x90 && velocity == 0);
     bool isCC = (status & 0xF0) == 0xB0;
 
+    // MPE member channels: notes open/close a per-note expression stream
+    if (g_mpeMember[channel]) {
+        MpeNoteState& note = g_mpeNotes[device * 16 + channel];
+        if (isNoteOn) {
+            note.active = true;
+        }
+        else if (isNoteOff) {
+            note.active = false;
+        }
+        else if (ProcessMpeExpression(status & 0xF0, channel, device, number, velocity)) {
+            return;
+        }
+    }
+    if (!isNoteOn && !isNoteOff && !isCC) {
+        ProcessChannelMessage(status & 0xF0, channel, device, number, velocity);
+        return;
+    }
+
     // Learning mode check
     {
         std::lock_guard<std::mutex> lock(g_learnMutex);
@@ -543,33 +2727,122 @@ void midiCallback(double, std::vector<unsigned char>* msg, void*) {
         }
     }
 
-    // Track physical state
-    if (isNoteOn) g_pianoPhysicalDown[number] = true;
-    if (isNoteOff) g_pianoPhysicalDown[number] = false;
+    // CC immediately if not learning; 14-bit and (N)RPN parts wait for the full value
+    if (isCC && !ProcessParamCC(device, channel, number, velocity)) {
+        ProcessMIDIEvent(status & 0xF0, number, velocity, channel, device);
+    }
+    if (!isNoteOn && !isNoteOff) return;
+    if (isNoteOn && !g_learning) AdvanceSequences(device, channel, number, ev.time);
 
-    // CC immediately if not learning
-    if (isCC) {
-        ProcessMIDIEvent(status & 0xF0, number, velocity);
+    // Note sequencing: see Chord Collector
+    int slot = NoteSlot(device, channel, number);
+    int stage;
+    {
+        std::lock_guard<std::mutex> lock(g_chordMutex);
+        stage = g_noteStage[slot];
+        if (isNoteOff && stage == NOTE_PENDING) g_noteStage[slot] = NOTE_RELEASED;
+    }
+    if (isNoteOff && stage == NOTE_PENDING) {
+        ReleaseNoteHeld(device, channel, number);
+        return;
+    }
+    if (stage != NOTE_IDLE) {
+        FlushChord(); // struck again inside the window: settle the first strike
+        if (isNoteOff) {
+            ReleaseNoteHeld(device, channel, number);
+            return; // it ended with that tap
+        }
     }
-    
-    // Chord grouping logic for Note On
     if (isNoteOn) {
-        std::lock_guard<std::mutex> lock(g_chordMutex);
-        g_chordBuffer.push_back(number);
-        // Signal main thread to reset/start the chord timer
-        PostMessage(g_hwndMain, WM_CHORD_SIGNAL, 0, 0);
+        auto view = g_view.load();
+        if (view && view->profile->chordNote[number]) {
+            {
+                std::lock_guard<std::mutex> lock(g_chordMutex);
+                g_chordBuffer.push_back(slot);
+                g_noteStage[slot] = NOTE_PENDING;
+            }
+            g_chordWaiting = true;
+            g_chordDeadline = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(ev.time)) +
+                              std::chrono::milliseconds(CHORD_THRESHOLD_MS);
+            return;
+        }
     }
-    
-    // Process Note Off immediately
-    if (isNoteOff) {
-        ProcessMIDIEvent(status & 0xF0, number, velocity);
+    ProcessMIDIEvent(status & 0xF0, number, velocity, channel, device);
+}
+
+// Consumes the merged input stream. While the motion engine has something to
+// emit, waits are bounded by the next motion tick, so pointer output runs at
+// a fixed rate on this same thread; an open chord window bounds them too.
+void MidiEngineThread() {
+    using clock = std::chrono::steady_clock;
+    const auto period = std::chrono::microseconds(1000000 / g_motion.rateHz);
+    const float dt = 1.f / g_motion.rateHz;
+    clock::time_point nextTick;
+    bool ticking = false;
+    auto wake = [] { return !g_midiEvents.empty() || !g_midiEngineRunning; };
+
+    std::unique_lock<std::mutex> lock(g_midiEventMutex);
+    while (true) {
+        if (!ticking && MotionActive()) {
+            ticking = true;
+            nextTick = clock::now() + period;
+            timeBeginPeriod(1); // default scheduler granularity is ~15 ms
+        }
+        if (g_chordWaiting) g_midiEventCv.wait_until(lock, ticking ? std::min(nextTick, g_chordDeadline) : g_chordDeadline, wake);
+        else if (ticking) g_midiEventCv.wait_until(lock, nextTick, wake);
+        else g_midiEventCv.wait(lock, wake);
+
+        // Ahead of any later note, so a late wakeup cannot stretch the window
+        if (g_chordWaiting && clock::now() >= g_chordDeadline) {
+            lock.unlock();
+            FlushChord();
+            lock.lock();
+        }
+        if (!g_midiEvents.empty()) {
+            MidiEvent ev = g_midiEvents.front();
+            g_midiEvents.pop_front();
+            lock.unlock();
+            ProcessMidiInput(ev);
+            lock.lock();
+        }
+        else if (!g_midiEngineRunning) break; // stopping, queue drained
+
+        // A due tick runs whatever the queue holds, so a CC flood cannot stall motion
+        if (ticking && clock::now() >= nextTick) {
+            lock.unlock();
+            MotionTick(dt);
+            lock.lock();
+            // Fell behind (system stall): skip ticks rather than bursting
+            nextTick += period;
+            if (nextTick < clock::now()) nextTick = clock::now() + period;
+            if (!MotionActive()) {
+                ticking = false;
+                timeEndPeriod(1);
+            }
+        }
+    }
+    if (ticking) timeEndPeriod(1);
+}
+
+void StartMidiEngine() {
+    g_midiEngineRunning = true;
+    g_midiEngineThread = std::thread(MidiEngineThread);
+}
+
+void StopMidiEngine() {
+    {
+        std::lock_guard<std::mutex> lock(g_midiEventMutex);
+        g_midiEngineRunning = false;
     }
+    g_midiEventCv.notify_one();
+    if (g_midiEngineThread.joinable()) g_midiEngineThread.join();
 }
 
-void ProcessChord(const std::vector<int>& chord) {
-    if (chord.empty()) return;
+void ProcessChord(const std::vector<int>& chordSlots) {
+    if (chordSlots.empty()) return;
 
-    std::vector<int> sortedChord = chord;
+    std::vector<int> sortedChord;
+    for (int slot : chordSlots) sortedChord.push_back(slot & 127);
     std::sort(sortedChord.begin(), sortedChord.end());
     sortedChord.erase(std::unique(sortedChord.begin(), sortedChord.end()), sortedChord.end());
 
@@ -577,124 +2850,224 @@ void ProcessChord(const std::vector<int>& chord) {
     for (int n : sortedChord) chordStr += std::to_string(n) + " ";
     SendLog("Processing MIDI chord: [ " + chordStr + "]");
     
+    auto view = g_view.load();
+    if (!view) return;
+    const auto& prof = view->profile;
     std::lock_guard<std::recursive_mutex> lock(g_mappingsMutex);
     bool found = false;
 
-    // 1. Try to find a specific chord mapping
+    // 1. Try to find a specific chord mapping: exact notes first, then the
+    // pitch-class set, then the chord shape in any key
     if (sortedChord.size() > 1) {
-        for (const auto& m : g_mappings) {
-            if (m.midi_type != 2) continue;
-
-            // Context Stack Filtering
-            if (!m.title_pattern.empty()) {
-                std::string currentTitle = WideToUtf8(g_currentWindowTitle);
-                if (currentTitle.find(m.title_pattern) == std::string::npos) continue;
-            }
-            if (!m.app_pattern.empty()) {
-                std::string currentApp = WideToUtf8(g_currentApp);
-                if (currentApp.find(m.app_pattern) == std::string::npos) continue;
-            }
+        // The device and channel every held note shares, or -2 if they differ:
+        // a chord bound to one controller or channel needs all its notes from it
+        int device = chordSlots[0] >> 11, channel = (chordSlots[0] >> 7) & 15;
+        for (int slot : chordSlots) {
+            if (slot >> 11 != device) device = -2;
+            if (((slot >> 7) & 15) != channel) channel = -2;
+        }
+        auto usable = [&](int idx) {
+            const auto& m = prof->mappings[idx];
+            if (m.device >= 0 && m.device != device) return false;
+            if (m.channel >= 0 && m.channel != channel) return false;
+            // chords are not keyed: any active layer
+            return (m.layers & g_layers.Active()) && view->active[idx];
+        };
+        int hit = -1;
+        for (size_t idx = 0; idx < prof->mappings.size() && hit < 0; idx++) {
+            const auto& m = prof->mappings[idx];
+            if (m.midi_type != 2 || m.chord_match) continue;
+            if (!usable((int)idx)) continue; // device/channel, layers, context filters
 
             // Compare sorted notes
             std::vector<int> targetChord = m.midi_chord;
             std::sort(targetChord.begin(), targetChord.end());
             targetChord.erase(std::unique(targetChord.begin(), targetChord.end()), targetChord.end());
-
-            if (targetChord == sortedChord) {
-                SimulateKeyCombo(m.key_vk, m.modifiers);
-                SendLog("Match found! Triggering VK " + std::to_string(m.key_vk));
-                found = true;
-                break;
-            }
+            if (targetChord == sortedChord) hit = (int)idx;
+        }
+        auto probe = [&](unsigned int bucket) {
+            for (unsigned int c = prof->chordStart[bucket]; c < prof->chordStart[bucket + 1]; c++)
+                if (usable(prof->chordList[c])) return prof->chordList[c];
+            return -1;
+        };
+        unsigned int mask = PitchClassMask(sortedChord);
+        if (hit < 0) hit = probe(mask);
+        if (hit < 0) hit = probe(CHORD_MASKS + ChordShape(mask));
+
+        if (hit >= 0) {
+            SendKeyProgramTap(prof->keys[hit]);
+            SendLog("Match found! Triggering VK " + std::to_string(prof->mappings[hit].key_vk));
+            found = true;
         }
     }
 
     // 2. If no chord mapping or single note, process individual mappings
     if (!found) {
-        for (int note : sortedChord) {
-            ProcessMIDIEvent(0x90, note, 100); // Trigger as standard Note On
+        std::vector<int> slots = chordSlots;
+        std::sort(slots.begin(), slots.end());
+        slots.erase(std::unique(slots.begin(), slots.end()), slots.end());
+        for (int slot : slots) {
+            bool tap;
+            {
+                std::lock_guard<std::mutex> chordLock(g_chordMutex);
+                tap = g_noteStage[slot] == NOTE_RELEASED;
+            }
+            // Trigger as standard Note On, on the key it was played on. Already
+            // let go: its key goes down and up in one SendInput call.
+            std::vector<INPUT> batch;
+            if (tap) t_inputBatch = &batch;
+            ProcessMIDIEvent(0x90, slot & 127, 100, (slot >> 7) & 15, slot >> 11);
+            if (tap) {
+                ProcessMIDIEvent(0x80, slot & 127, 0, (slot >> 7) & 15, slot >> 11);
+                t_inputBatch = nullptr;
+                SendInputs(batch.data(), (unsigned int)batch.size());
+            }
         }
     }
 }
 
-void ProcessMIDIEvent(int type, int number, int velocity) {
+// The chord window closed (engine thread). Offs held back for its notes
+// were applied by ProcessChord; a matched chord consumes them.
+void FlushChord() {
+    g_chordWaiting = false;
+    std::vector<int> chord;
+    {
+        std::lock_guard<std::mutex> lock(g_chordMutex);
+        chord.swap(g_chordBuffer);
+    }
+    if (!g_learning) ProcessChord(chord);
+    std::lock_guard<std::mutex> lock(g_chordMutex);
+    for (int slot : chord) g_noteStage[slot] = NOTE_IDLE;
+}
+
+// Drops an open chord window unplayed (learn mode)
+void DiscardChord() {
+    std::lock_guard<std::mutex> lock(g_chordMutex);
+    for (int slot : g_chordBuffer) g_noteStage[slot] = NOTE_IDLE;
+    g_chordBuffer.clear();
+}
+
+void ProcessMIDIEvent(int type, int number, int velocity, int channel, int device) {
     bool isNoteOn = (type == 0x90) && velocity > 0;
     bool isNoteOff = (type == 0x80) || ((type == 0x90) && velocity == 0);
     bool isCC = (type == 0xB0);
+    if (number < 0 || number > 127) return;
+    // Notes without a source key (none today) fall back to device 0, channel 1
+    int slot = (device >= 0 && channel >= 0) ? NoteSlot(device, channel, number) : number;
 
     // Update Piano Roll and Gesture state
-    if (isNoteOn && number >= 0 && number < 128) {
+    if (isNoteOn) {
         g_pianoVelocity[number] = velocity;
         PostToWebView({ {"type", "midi_note"}, {"note", number}, {"velocity", velocity} });
         
         std::lock_guard<std::mutex> lock(g_gestureMutex);
-        auto& state = g_keyStates[number];
+        auto& state = g_keyStates[slot];
         DWORD now = GetTickCount();
         if (now - state.lastPressTime < GESTURE_WINDOW_MS) {
             state.tapCount++;
         } else {
             state.tapCount = 1;
-            SetTimer(g_hwndMain, GESTURE_TIMER_ID + number, GESTURE_WINDOW_MS, NULL);
+            SetTimer(g_hwndMain, GESTURE_TIMER_ID + slot, GESTURE_WINDOW_MS, NULL);
         }
         state.lastPressTime = now;
         state.processingGesture = true;
         state.holdTriggered = false;
     }
-    else if (isNoteOff && number >= 0 && number < 128) {
+    else if (isNoteOff) {
         g_pianoVelocity[number] = 0;
         PostToWebView({ {"type", "midi_note"}, {"note", number}, {"velocity", 0} });
         
         std::lock_guard<std::mutex> lock(g_gestureMutex);
-        auto& state = g_keyStates[number];
+        auto& state = g_keyStates[slot];
         DWORD duration = GetTickCount() - state.lastPressTime;
         if (duration >= LONG_HOLD_MS && !state.holdTriggered) {
             state.holdTriggered = true;
-            KillTimer(g_hwndMain, GESTURE_TIMER_ID + number);
+            KillTimer(g_hwndMain, GESTURE_TIMER_ID + slot);
             state.tapCount = 0;
             state.processingGesture = false;
-            ResolveGesture(number, 2); // Long Hold
+            ResolveGesture(slot, 2); // Long Hold
         }
     }
 
     int oldCCVal = -1;
-    if (isCC && number >= 0 && number < 128) {
+    if (isCC) {
         oldCCVal = g_pianoCC[number];
         g_pianoCC[number] = velocity;
+        if (device >= 0 && channel >= 0) {
+            // Edge detection must not mix two controllers sending the same CC
+            oldCCVal = g_midiDevices[device].ccValue[channel][number];
+            g_midiDevices[device].ccValue[channel][number] = (unsigned char)velocity;
+        }
         PostToWebView({ {"type", "midi_cc"}, {"cc", number}, {"value", velocity} });
 
         // Global Sustain Pedal Support (CC 64)
         if (number == 64) {
-            std::lock_guard<std::mutex> lock(g_sustainMutex);
-            if (velocity > 63 && !g_sustainActive) {
-                g_sustainActive = true;
-                SendLog("Sustain Pedal: ON", "mapping");
-            } else if (velocity <= 63 && g_sustainActive) {
-                g_sustainActive = false;
-                SendLog("Sustain Pedal: OFF", "mapping");
-                for (int vk : g_sustainedVKs) {
-                    SendKeyInput(vk, false);
+            bool released = false;
+            {
+                std::lock_guard<std::mutex> lock(g_sustainMutex);
+                if (velocity > 63 && !g_sustainActive) {
+                    g_sustainActive = true;
+                    g_feedbackDirty = true;
+                    SendLog("Sustain Pedal: ON", "mapping");
+                } else if (velocity <= 63 && g_sustainActive) {
+                    g_sustainActive = false;
+                    g_feedbackDirty = true;
+                    SendLog("Sustain Pedal: OFF", "mapping");
+                    released = true;
                 }
-                g_sustainedVKs.clear();
+            }
+            if (released) {
+                std::lock_guard<std::recursive_mutex> lock(g_mappingsMutex);
+                ReleaseHeld(HELD_SUSTAINED);
             }
         }
     }
 
-    // CC edge detection flags
-    bool ccCrossedUp = (isCC && oldCCVal <= 63 && velocity > 63);
-    bool ccCrossedDown = (isCC && oldCCVal > 63 && velocity <= 63);
-
-    // Execute mappings
+    // Execute mappings: only the bucket for this (device, channel, kind, number)
+    auto view = g_view.load();
+    if (!view) return;
+    const auto& prof = view->profile;
     std::lock_guard<std::recursive_mutex> lock(g_mappingsMutex);
-    for (const auto& m : g_mappings) {
-        // Context filtering
-        if (!m.title_pattern.empty()) {
-            std::string currentTitle = WideToUtf8(g_currentWindowTitle);
-            if (currentTitle.find(m.title_pattern) == std::string::npos) continue;
-        }
-        if (!m.app_pattern.empty()) {
-            std::string currentApp = WideToUtf8(g_currentApp);
-            if (currentApp.find(m.app_pattern) == std::string::npos) continue;
+    bool bucketed = device >= 0 && channel >= 0;
+    int key = DispatchKey(bucketed ? device : 0, bucketed ? channel : 0, isCC ? 1 : 0, number);
+
+    // A release is looked up on the layer its press was
+    bool pressed = isNoteOn || (isCC && velocity >= 64);
+    int entry = bucketed ? view->Find(key) : -1;
+    unsigned char& held = g_pressLayer[key];
+    int layer = held ? held - 1 : ResolveLayer(*view, entry);
+    if (layer >= view->layerCount) layer = 0; // pressed under a profile with more layers
+    held = pressed ? (unsigned char)(layer + 1) : 0;
+
+    // g_heldKeys decides what comes up: a release lets go of whatever this
+    // input holds, even if no mapping passes the context or layer any more
+    if (isNoteOff || (isCC && velocity < 64 && oldCCVal >= 64)) {
+        int source = isCC && !bucketed ? number : key; // as ApplyCCAction is given below
+        std::lock_guard<std::mutex> sustainLock(g_sustainMutex);
+        if (isNoteOff && g_sustainActive) SustainHeld(source);
+        else if (ReleaseHeld(source))
+            SendLog((isCC ? "CC " : "Note ") + std::to_string(number) + " -> Key Up", "mapping");
+    }
+
+    size_t first = 0, last = prof->mappings.size();
+    if (bucketed) {
+        first = last = 0;
+        if (entry >= 0) {
+            const unsigned int* start = &view->dispatchStart[(size_t)entry * view->layerCount + layer];
+            first = start[0];
+            last = start[1];
         }
+    }
+    bool layerKeyHit = false, ccKeyPress = false;
+    for (size_t c = first; c < last; ++c) {
+        int idx = bucketed ? view->dispatchList[c] : (int)c;
+        const auto& m = prof->mappings[idx];
+        if (!bucketed && !((m.layers >> layer) & 1)) continue;
+        // Channel/device filtering (chord-resolved notes carry neither)
+        if (m.channel >= 0 && channel >= 0 && m.channel != channel) continue;
+        if (m.device >= 0 && device >= 0 && m.device != device) continue;
+
+        if (!view->active[idx]) continue; // context filters
 
         // Profile switching
         if (m.profile_switch >= 0) {
@@ -709,91 +3082,77 @@ void ProcessMIDIEvent(int type, int number, int velocity) {
         // Note-to-Key Mapping
         if (m.midi_type == 0 && number == m.midi_num && m.gesture_id == 0) {
             if (isNoteOn) {
-                if (!g_pianoPhysicalDown[number]) continue; // Rapid tap safety
                 if (velocity < m.vel_min) continue;
                 if (g_velocityZonesEnabled) {
                     if (m.vel_zone == 1 && velocity > 63) continue;
                     if (m.vel_zone == 2 && velocity < 64) continue;
                 }
-                SendKeyInput(m.key_vk, true, m.modifiers);
+                PressHeld(key, m, prof->keys[idx]);
                 SendLog("Note " + std::to_string(number) + " -> Key Down: " + std::to_string(m.key_vk), "mapping");
             }
-            else if (isNoteOff) {
-                std::lock_guard<std::mutex> lock(g_sustainMutex);
-                if (g_sustainActive) {
-                    g_sustainedVKs.insert(m.key_vk);
-                    SendLog("Note " + std::to_string(number) + " -> Sustaining VK " + std::to_string(m.key_vk), "mapping");
-                } else {
-                    SendKeyInput(m.key_vk, false, m.modifiers);
-                    SendLog("Note " + std::to_string(number) + " -> Key Up: " + std::to_string(m.key_vk), "mapping");
-                }
+            else if (isNoteOff && g_sustainActive) {
+                SendLog("Note " + std::to_string(number) + " -> Sustaining VK " + std::to_string(m.key_vk), "mapping");
             }
         }
 
         // CC-to-Action Mapping (Edge Detected)
         if (m.midi_type == 1 && isCC && number == m.midi_num) {
-            switch (m.cc_action) {
-            case 0: // Keypress (Now Momentary by default for games)
-                if (ccCrossedUp) {
-                    SendKeyInput(m.key_vk, true, m.modifiers);
-                    SendLog("CC " + std::to_string(number) + " -> Key Down: " + std::to_string(m.key_vk), "mapping");
-                } else if (ccCrossedDown) {
-                    SendKeyInput(m.key_vk, false, m.modifiers);
-                    SendLog("CC " + std::to_string(number) + " -> Key Up: " + std::to_string(m.key_vk), "mapping");
-                }
-                break;
-            case 1: SimulateMouseMove((velocity - 64) * 2, 0); break;
-            case 2: SimulateMouseMove(0, (velocity - 64) * 2); break;
-            case 3: SimulateScroll((velocity - 64) * 20); break;
-            case 4: // Hold Key (Dedicated toggle behavior or held state)
-                if (ccCrossedUp && !g_ccHoldActive[m.midi_num]) {
-                    SendKeyInput(m.key_vk, true);
-                    g_ccHoldActive[m.midi_num] = true;
-                }
-                else if (ccCrossedDown && g_ccHoldActive[m.midi_num]) {
-                    SendKeyInput(m.key_vk, false);
-                    g_ccHoldActive[m.midi_num] = false;
-                }
-                break;
-            }
+            ApplyCCAction(m, prof->keys[idx], (float)velocity, (float)oldCCVal,
+                          bucketed ? DispatchKey(device, channel, 1, number) : number,
+                          "CC " + std::to_string(number));
+            if ((m.cc_action == 0 || m.cc_action == 4) && velocity >= 64 && oldCCVal < 64) ccKeyPress = true;
         }
         
         // Macros, AI, HUD
         if (m.midi_type == 4 && isNoteOn && number == m.midi_num && m.gesture_id == 0) {
-            SimulateText(m.macro_text);
+            SimulateText(prof->macroWide[idx]);
         }
         if (m.midi_type == 5 && isNoteOn && number == m.midi_num && m.gesture_id == 0) {
             PostToWebView({ {"type", "run_ai"}, {"prompt", m.ai_prompt} });
             SendLog("AI Prompt sent: " + m.ai_prompt);
         }
-        if (m.midi_type == 3 && number == m.midi_num) {
-            if (isNoteOn) PostToWebView({ {"type", "hud"}, {"active", true}, {"title", WideToUtf8(GetModifierString(m.modifiers) + GetKeyName(m.key_vk))} });
-            else if (isNoteOff) PostToWebView({ {"type", "hud"}, {"active", false} });
+        if (m.midi_type == 3 && number == m.midi_num && isCC == m.layer_cc) {
+            bool down = isCC ? (velocity >= 64 && oldCCVal < 64) : isNoteOn;
+            bool up = isCC ? (velocity < 64 && oldCCVal >= 64) : isNoteOff;
+            if (down || up) {
+                ApplyLayerKey(m, down);
+                layerKeyHit = true;
+            }
         }
     }
+
+    // A one-shot layer lasts for one mapped key press: a Note On, or a CC
+    // key/hold mapping crossing upward, not every CC value above the threshold
+    bool discrete = (isNoteOn && last > first) || ccKeyPress;
+    if (discrete && !layerKeyHit && g_layers.oneShot) {
+        g_layers.oneShot = 0;
+        g_feedbackDirty = true;
+    }
 }
 
-void ResolveGesture(int midi_num, int gesture_id) {
+void ResolveGesture(int slot, int gesture_id) {
+    int midi_num = slot & 127, channel = (slot >> 7) & 15, device = slot >> 11;
+    auto view = g_view.load();
+    if (!view) return;
+    const auto& prof = view->profile;
     std::lock_guard<std::recursive_mutex> lock(g_mappingsMutex);
-    for (const auto& m : g_mappings) {
+    int layer = ResolveLayer(*view, view->Find(DispatchKey(device, channel, 0, midi_num)));
+    for (size_t idx = 0; idx < prof->mappings.size(); ++idx) {
+        const auto& m = prof->mappings[idx];
         if (m.midi_num != midi_num) continue;
+        if (m.midi_type == 1 || m.midi_type == 2 || m.midi_type >= 6) continue; // note-keyed only
+        if (!((m.layers >> layer) & 1)) continue;
+        if (m.channel >= 0 && m.channel != channel) continue;
+        if (m.device >= 0 && m.device != device) continue;
         
         // Exact gesture match, and ignore gesture 0 here because it's handled immediately in ProcessMIDIEvent
         if (m.gesture_id != gesture_id || m.gesture_id == 0) continue;
 
-        // Context check
-        if (!m.title_pattern.empty()) {
-            std::string currentTitle = WideToUtf8(g_currentWindowTitle);
-            if (currentTitle.find(m.title_pattern) == std::string::npos) continue;
-        }
-        if (!m.app_pattern.empty()) {
-            std::string currentApp = WideToUtf8(g_currentApp);
-            if (currentApp.find(m.app_pattern) == std::string::npos) continue;
-        }
+        if (!view->active[idx]) continue; // context filters
 
         // Execute (Simplified trigger for gesture demo)
-        if (m.midi_type == 0) SimulateKeyCombo(m.key_vk, m.modifiers);
-        else if (m.midi_type == 4) SimulateText(m.macro_text);
+        if (m.midi_type == 0) SendKeyProgramTap(prof->keys[idx]);
+        else if (m.midi_type == 4) SimulateText(prof->macroWide[idx]);
         else if (m.midi_type == 5) PostToWebView({ {"type", "run_ai"}, {"prompt", m.ai_prompt} });
     }
 }
@@ -804,7 +3163,7 @@ void ResolveGesture(int midi_num, int gesture_id) {
 
 void ScanMidiPorts() {
     g_ports.clear();
-    RtMidiIn tempIn;
+    RtMidiIn tempIn(g_midiApi);
     int n = tempIn.getPortCount();
     json portsArr = json::array();
     for (int i = 0; i < n; ++i) {
@@ -812,54 +3171,429 @@ void ScanMidiPorts() {
         g_ports.push_back(name);
         portsArr.push_back(name);
     }
-    PostToWebView({ {"type", "ports"}, {"ports", portsArr} });
+    g_outPorts.clear();
+    json outArr = json::array();
+    try {
+        RtMidiOut tempOut(OutputApi());
+        int nOut = tempOut.getPortCount();
+        for (int i = 0; i < nOut; ++i) {
+            std::string name = tempOut.getPortName(i);
+            g_outPorts.push_back(name);
+            outArr.push_back(name);
+        }
+    }
+    catch (RtMidiError&) {}
+    PostToWebView({ {"type", "ports"}, {"ports", portsArr}, {"outputs", outArr}, {"feedback_port", g_feedbackPortName} });
+}
+
+int FindOpenDevice(const std::string& portName) {
+    for (int id = 0; id < MAX_MIDI_DEVICES; id++)
+        if (g_midiDevices[id].in && g_midiDevices[id].portName == portName) return id;
+    return -1;
+}
+
+// Returns the persistent id for a port, registering it on first sight; -1
+// once MAX_MIDI_DEVICES ports are registered.
+int DeviceIdForPort(const std::string& portName) {
+    for (size_t i = 0; i < g_deviceNames.size(); i++)
+        if (g_deviceNames[i] == portName) return (int)i;
+    if (g_deviceNames.size() < MAX_MIDI_DEVICES) {
+        g_deviceNames.push_back(portName);
+        return (int)g_deviceNames.size() - 1;
+    }
+    // Registry full. Ids are never handed to another port: mappings and
+    // routes naming one would silently retarget to a different controller.
+    return -1;
+}
+
+void SendDevicesToUI() {
+    json devices = json::array();
+    for (int id = 0; id < (int)g_deviceNames.size(); id++)
+        devices.push_back({ {"id", id}, {"name", g_deviceNames[id]}, {"connected", g_midiDevices[id].in != nullptr} });
+    PostToWebView({ {"type", "devices"}, {"devices", devices} });
 }
 
 void ConnectMidi(int portIndex) {
     if (portIndex < 0 || portIndex >= (int)g_ports.size()) return;
+    std::string portName = g_ports[portIndex];
+    if (FindOpenDevice(portName) >= 0) return;
+    int id = DeviceIdForPort(portName);
+    if (id < 0) {
+        SendLog("Connection failed: " + std::to_string(MAX_MIDI_DEVICES) + " controllers are already registered, so " +
+                portName + " cannot get a device id.");
+        return;
+    }
+    MidiDevice& dev = g_midiDevices[id];
     try {
-        g_midiIn = std::make_unique<RtMidiIn>();
-        g_midiIn->openPort(portIndex);
-        g_midiIn->setCallback(&midiCallback);
+        dev.in = std::make_unique<RtMidiIn>(g_midiApi);
+        dev.in->openPort(portIndex);
+        dev.in->setCallback(&midiCallback, (void*)(intptr_t)id);
+        dev.portName = portName;
+        memset(dev.ccValue, 0, sizeof(dev.ccValue));
+        RebuildMidiPrefilter();
+        ApplySystemIgnores();
         g_connected = true;
-        g_lastConnectedPort = portIndex;
-        g_lastConnectedPortName = g_ports[portIndex];
-        PostToWebView({ {"type", "connected"}, {"portName", g_ports[portIndex]} });
-        SendLog("Connected to: " + g_ports[portIndex]);
+        if (std::find(g_lastConnectedPortNames.begin(), g_lastConnectedPortNames.end(), portName) == g_lastConnectedPortNames.end())
+            g_lastConnectedPortNames.push_back(portName);
+        PostToWebView({ {"type", "connected"}, {"portName", portName}, {"device", id} });
+        SendDevicesToUI();
+        SendLog("Connected to: " + portName + " (device " + std::to_string(id) + ")");
         SendStatus("Connected.");
         SaveConfig();
     }
     catch (RtMidiError& e) {
         SendLog("Connection failed: " + std::string(e.getMessage()));
-        g_midiIn.reset();
+        dev.in.reset();
     }
 }
 
-void DisconnectMidi() {
-    g_midiIn.reset();
+void DisconnectMidiDevice(int id) {
+    if (id < 0 || id >= MAX_MIDI_DEVICES || !g_midiDevices[id].in) return;
+    std::string portName = g_midiDevices[id].portName;
+    g_midiDevices[id].in.reset();
+    g_midiDevices[id].portName.clear();
+    g_motionReset = true;
+    g_lastConnectedPortNames.erase(std::remove(g_lastConnectedPortNames.begin(), g_lastConnectedPortNames.end(), portName),
+                                   g_lastConnectedPortNames.end());
     g_connected = false;
-    PostToWebView({ {"type", "disconnected"} });
-    SendLog("MIDI disconnected.");
-    SendStatus("Disconnected.");
+    for (const auto& dev : g_midiDevices)
+        if (dev.in) g_connected = true;
+    PostToWebView({ {"type", "disconnected"}, {"portName", portName}, {"device", id} });
+    SendDevicesToUI();
+    SendLog("MIDI disconnected: " + portName);
+    SendStatus(g_connected ? "Connected." : "Disconnected.");
+    SaveConfig();
 }
 
 void TryAutoReconnect() {
-    if (g_connected || !g_autoReconnect || g_lastConnectedPortName.empty()) return;
-    RtMidiIn tempIn;
+    if (!g_autoReconnect || g_lastConnectedPortNames.empty()) return;
+    bool missing = false;
+    for (const auto& name : g_lastConnectedPortNames)
+        if (FindOpenDevice(name) < 0) missing = true;
+    if (!missing) return;
+
+    RtMidiIn tempIn(g_midiApi);
     int n = tempIn.getPortCount();
-    for (int i = 0; i < n; i++) {
-        if (tempIn.getPortName(i) == g_lastConnectedPortName) {
-            ScanMidiPorts();
-            ConnectMidi(i);
-            if (g_connected) {
-                SendLog("Auto-reconnected to: " + g_lastConnectedPortName);
-                if (!g_lastProfilePath.empty()) {
-                    LoadMappings(g_lastProfilePath);
-                    SendLog("Auto-loaded last profile.");
+    std::vector<std::string> available;
+    for (int i = 0; i < n; i++) available.push_back(tempIn.getPortName(i));
+
+    bool reconnected = false;
+    std::vector<std::string> wanted = g_lastConnectedPortNames;
+    for (const auto& name : wanted) {
+        if (FindOpenDevice(name) >= 0) continue;
+        if (std::find(available.begin(), available.end(), name) == available.end()) continue;
+        if (!reconnected) ScanMidiPorts();
+        auto it = std::find(g_ports.begin(), g_ports.end(), name);
+        if (it == g_ports.end()) continue;
+        ConnectMidi((int)(it - g_ports.begin()));
+        if (FindOpenDevice(name) >= 0) {
+            reconnected = true;
+            SendLog("Auto-reconnected to: " + name);
+        }
+    }
+
+    if (reconnected) {
+        if (!g_midiOut && !g_feedbackPortName.empty()) ConnectFeedback(g_feedbackPortName);
+        if (!g_lastProfilePath.empty()) {
+            LoadMappings(g_lastProfilePath);
+            SendLog("Auto-loaded last profile.");
+        }
+    }
+}
+
+// ══════════════════════════════════════════
+//  Controller Feedback
+// ══════════════════════════════════════════
+
+// Engine state is mirrored to the controller through a shadow table: the
+// target is recomputed only when something marked it dirty, and only slots
+// that differ from what the controller last received are sent.
+
+void ConnectFeedback(const std::string& portName) {
+    g_midiOut.reset();
+    g_feedbackPortName = portName;
+    if (portName.empty()) return;
+    try {
+        auto out = std::make_unique<RtMidiOut>(OutputApi());
+        unsigned int n = out->getPortCount();
+        for (unsigned int i = 0; i < n; ++i) {
+            if (out->getPortName(i) == portName) { out->openPort(i); break; }
+        }
+        if (!out->isPortOpen()) {
+            SendLog("Feedback port not found: " + portName);
+            return;
+        }
+        g_midiOut = std::move(out);
+        // Assume a dark controller; the first flush lights what is active.
+        memset(g_feedbackShadow, 0, sizeof(g_feedbackShadow));
+        g_feedbackDirty = true;
+        SendLog("Feedback output: " + portName);
+    }
+    catch (RtMidiError& e) {
+        SendLog("Feedback port failed: " + std::string(e.getMessage()));
+        g_midiOut.reset();
+    }
+}
+
+void RecomputeFeedbackTarget() {
+    memset(g_feedbackTarget, 0, sizeof(g_feedbackTarget));
+    auto slot = [](int kind, int channel, int number) -> unsigned char& {
+        return g_feedbackTarget[(kind << 11) | ((channel & 15) << 7) | (number & 127)];
+    };
+
+    {
+        std::lock_guard<std::mutex> lock(g_sustainMutex);
+        slot(1, 0, 64) = g_sustainActive ? 127 : 0;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(g_mappingsMutex);
+    for (const auto& m : g_mappings) {
+        if (m.midi_num < 0 || m.midi_num > 127) continue;
+        int ch = m.channel >= 0 ? m.channel : 0;
+        if (m.profile_switch >= 0 && m.midi_type == 0) {
+            // Profile pads: the pad of the active slot stays lit
+            slot(0, ch, m.midi_num) = (m.profile_switch == g_activeProfileSlot) ? 127 : 0;
+        }
+        else if (m.midi_type == 1 && m.cc_action == 4) {
+            auto it = g_ccHoldActive.find((m.midi_type << 14) | m.midi_num);
+            slot(1, ch, m.midi_num) = (it != g_ccHoldActive.end() && it->second) ? 127 : 0;
+        }
+        else if (m.midi_type == 3) {
+            // Layer keys stay lit while their layer is on
+            slot(m.layer_cc ? 1 : 0, ch, m.midi_num) = ((g_layers.Active() >> m.layer_target) & 1) ? 127 : 0;
+        }
+    }
+}
+
+void FlushFeedback() {
+    if (!g_midiOut) return;
+    if (g_feedbackDirty.exchange(false)) RecomputeFeedbackTarget();
+
+    // Rate limit: at most FEEDBACK_MAX_PER_TICK changes per tick, the rest
+    // still differ from the shadow and go out on the next tick.
+    std::vector<std::vector<unsigned char>> batch;
+    for (int i = 0; i < FEEDBACK_SLOTS && (int)batch.size() < FEEDBACK_MAX_PER_TICK; ++i) {
+        if (g_feedbackTarget[i] == g_feedbackShadow[i]) continue;
+        unsigned char status = (unsigned char)(((i >> 11) ? 0xB0 : 0x90) | ((i >> 7) & 15));
+        batch.push_back({ status, (unsigned char)(i & 127), g_feedbackTarget[i] });
+        g_feedbackShadow[i] = g_feedbackTarget[i];
+    }
+    if (batch.empty()) return;
+    try {
+        g_midiOut->sendMessages(batch);
+    }
+    catch (RtMidiError& e) {
+        SendLog("Feedback output lost: " + std::string(e.getMessage()));
+        g_midiOut.reset();
+    }
+}
+
+// ══════════════════════════════════════════
+//  Profile Watcher
+// ══════════════════════════════════════════
+
+// One thread watches the directories holding the active, slot and app-bound
+// profiles. Editors often save in several steps, so a change is debounced;
+// the file is then parsed and compiled on the watcher thread and handed to
+// the UI thread through WM_PROFILE_RELOADED.
+#define WATCH_DEBOUNCE_MS 200
+
+struct WatchedDir {
+    std::wstring path;  // with trailing separator
+    HANDLE handle = INVALID_HANDLE_VALUE;
+    OVERLAPPED ov = {};
+    DWORD buffer[4096]; // FILE_NOTIFY_INFORMATION records, DWORD-aligned
+};
+std::thread g_watchThread;
+HANDLE g_watchWake = nullptr;             // watch list changed, or stopping
+std::atomic<bool> g_watchStopping{ false }; // also cancels a reload in progress
+std::mutex g_watchMutex;
+std::map<std::wstring, std::wstring> g_watchFiles; // normalized path -> path as configured
+std::vector<std::pair<std::wstring, std::shared_ptr<const CompiledProfile>>> g_reloadedProfiles; // under g_watchMutex
+
+std::wstring NormalizePath(const std::wstring& path) {
+    wchar_t full[MAX_PATH];
+    DWORD n = GetFullPathNameW(path.c_str(), MAX_PATH, full, nullptr);
+    std::wstring out = (n > 0 && n < MAX_PATH) ? std::wstring(full, n) : path;
+    for (auto& c : out) c = (wchar_t)towlower(c);
+    return out;
+}
+
+// Called on the UI thread whenever the set of profile paths may have changed
+void UpdateProfileWatch() {
+    std::map<std::wstring, std::wstring> files;
+    auto add = [&files](const std::wstring& path) {
+        if (!path.empty()) files.emplace(NormalizePath(path), path);
+    };
+    add(g_lastProfilePath);
+    for (const auto& path : g_profileSlots) add(path);
+    for (const auto& [exe, path] : g_appProfileBindings) add(path);
+    {
+        std::lock_guard<std::mutex> lock(g_watchMutex);
+        if (files == g_watchFiles) return;
+        g_watchFiles = std::move(files);
+    }
+    if (g_watchWake) SetEvent(g_watchWake);
+}
+
+static bool ArmWatch(WatchedDir& dir) {
+    return ReadDirectoryChangesW(dir.handle, dir.buffer, sizeof(dir.buffer), FALSE,
+        FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME, nullptr, &dir.ov, nullptr) != 0;
+}
+
+static void CloseWatches(std::vector<std::unique_ptr<WatchedDir>>& dirs) {
+    for (auto& dir : dirs) {
+        CancelIoEx(dir->handle, &dir->ov);
+        DWORD bytes = 0;
+        GetOverlappedResult(dir->handle, &dir->ov, &bytes, TRUE);
+        CloseHandle(dir->handle);
+        CloseHandle(dir->ov.hEvent);
+    }
+    dirs.clear();
+}
+
+void ProfileWatchThread() {
+    using Clock = std::chrono::steady_clock;
+    std::vector<std::unique_ptr<WatchedDir>> dirs;
+    std::map<std::wstring, Clock::time_point> due; // normalized path -> reload time
+    bool refresh = true;
+
+    while (!g_watchStopping) {
+        if (refresh) {
+            refresh = false;
+            CloseWatches(dirs);
+            std::set<std::wstring> dirPaths;
+            {
+                std::lock_guard<std::mutex> lock(g_watchMutex);
+                for (const auto& [norm, path] : g_watchFiles)
+                    dirPaths.insert(norm.substr(0, norm.find_last_of(L"\\/") + 1));
+            }
+            for (const auto& path : dirPaths) {
+                if (dirs.size() >= MAXIMUM_WAIT_OBJECTS - 1) break;
+                auto dir = std::make_unique<WatchedDir>();
+                dir->path = path;
+                dir->handle = CreateFileW(path.c_str(), FILE_LIST_DIRECTORY,
+                    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                    FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+                if (dir->handle == INVALID_HANDLE_VALUE) continue;
+                dir->ov.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+                if (!ArmWatch(*dir)) {
+                    CloseHandle(dir->handle);
+                    CloseHandle(dir->ov.hEvent);
+                    continue;
                 }
+                dirs.push_back(std::move(dir));
+            }
+        }
+
+        std::vector<HANDLE> waits = { g_watchWake };
+        for (auto& dir : dirs) waits.push_back(dir->ov.hEvent);
+        DWORD timeout = INFINITE;
+        if (!due.empty()) {
+            auto next = std::min_element(due.begin(), due.end(),
+                [](const auto& a, const auto& b) { return a.second < b.second; })->second;
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next - Clock::now()).count();
+            timeout = (DWORD)std::max<long long>(0, wait);
+        }
+        DWORD r = WaitForMultipleObjects((DWORD)waits.size(), waits.data(), FALSE, timeout);
+        if (g_watchStopping) break;
+
+        if (r == WAIT_OBJECT_0) {
+            refresh = true;
+            continue;
+        }
+        if (r > WAIT_OBJECT_0 && r < WAIT_OBJECT_0 + waits.size()) {
+            WatchedDir& dir = *dirs[r - WAIT_OBJECT_0 - 1];
+            DWORD bytes = 0;
+            bool got = GetOverlappedResult(dir.handle, &dir.ov, &bytes, FALSE) != 0;
+            ResetEvent(dir.ov.hEvent);
+            auto when = Clock::now() + std::chrono::milliseconds(WATCH_DEBOUNCE_MS);
+            std::lock_guard<std::mutex> lock(g_watchMutex);
+            if (got && bytes > 0) {
+                const BYTE* p = (const BYTE*)dir.buffer;
+                while (true) {
+                    const auto* info = (const FILE_NOTIFY_INFORMATION*)p;
+                    std::wstring name = dir.path + std::wstring(info->FileName, info->FileNameLength / sizeof(WCHAR));
+                    for (auto& c : name) c = (wchar_t)towlower(c);
+                    if (g_watchFiles.count(name)) due[name] = when;
+                    if (!info->NextEntryOffset) break;
+                    p += info->NextEntryOffset;
+                }
+            } else {
+                // Overflow: the individual changes are lost, recheck the whole directory
+                for (const auto& [norm, path] : g_watchFiles)
+                    if (norm.compare(0, dir.path.size(), dir.path) == 0) due[norm] = when;
+            }
+            if (!ArmWatch(dir)) refresh = true;
+        }
+
+        // Reload whatever has been quiet for the debounce window
+        auto now = Clock::now();
+        for (auto it = due.begin(); it != due.end() && !g_watchStopping;) {
+            if (it->second > now) { ++it; continue; }
+            std::wstring path;
+            {
+                std::lock_guard<std::mutex> lock(g_watchMutex);
+                auto f = g_watchFiles.find(it->first);
+                if (f != g_watchFiles.end()) path = f->second;
+            }
+            it = due.erase(it);
+            if (path.empty()) continue;
+            auto prof = LoadCompiledProfile(path, &g_watchStopping);
+            if (!prof) continue; // a bad edit keeps the previous version live
+            {
+                std::lock_guard<std::mutex> lock(g_watchMutex);
+                g_reloadedProfiles.emplace_back(path, prof);
+            }
+            if (g_hwndMain) PostMessage(g_hwndMain, WM_PROFILE_RELOADED, 0, 0);
+        }
+    }
+    CloseWatches(dirs);
+}
+
+void StartProfileWatch() {
+    g_watchWake = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+    UpdateProfileWatch();
+    g_watchThread = std::thread(ProfileWatchThread);
+}
+
+void StopProfileWatch() {
+    if (!g_watchThread.joinable()) return;
+    g_watchStopping = true;
+    SetEvent(g_watchWake);
+    g_watchThread.join();
+    CloseHandle(g_watchWake);
+    g_watchWake = nullptr;
+}
+
+// UI thread: take reloaded profiles into the cache, and into the engine if
+// one of them is the active profile
+void ApplyReloadedProfiles() {
+    std::vector<std::pair<std::wstring, std::shared_ptr<const CompiledProfile>>> batch;
+    {
+        std::lock_guard<std::mutex> lock(g_watchMutex);
+        batch.swap(g_reloadedProfiles);
+    }
+    for (auto& [path, prof] : batch) {
+        auto it = g_profileCache.find(path);
+        if (it != g_profileCache.end()) it->second = prof;
+        if (path != g_lastProfilePath) continue;
+        bool unchanged = g_fileProfile && g_fileProfile->mappings == prof->mappings; // e.g. our own save
+        g_fileProfile = prof;
+        if (g_mappingsDirty && unchanged) continue;
+        if (g_mappingsDirty) {
+            // Both sides changed: the user decides which one wins
+            std::wstring text = L"The profile\n" + path + L"\nchanged on disk, but the editor has unsaved changes.\n\n"
+                                L"Reload it from disk and discard your changes?";
+            if (MessageBox(g_hwndMain, text.c_str(), L"MIDITypist", MB_YESNO | MB_ICONWARNING) != IDYES) {
+                SendLog("Profile changed on disk but kept your unsaved edits: " + WideToUtf8(path) +
+                        ". Saving will overwrite the file.");
+                continue;
             }
-            return;
         }
+        g_mappingsDirty = false;
+        if (ApplyProfileReload(prof))
+            SendLog("Profile reloaded from disk: " + WideToUtf8(path));
     }
 }
 
@@ -867,6 +3601,91 @@ void TryAutoReconnect() {
 //  Per-App Switching
 // ══════════════════════════════════════════
 
+// Win32 answers for ContextTracker. A cached process is held open, so its
+// pid cannot be handed out again, and a thread-pool wait posts its exit to
+// the UI thread, which forgets it and lets the handle go.
+class Win32ForegroundProvider : public ForegroundProvider {
+public:
+    std::uint32_t WindowProcess(WindowId window) override {
+        DWORD pid = 0;
+        GetWindowThreadProcessId((HWND)window, &pid);
+        return pid;
+    }
+    bool ProcessImage(std::uint32_t pid, std::wstring& image) override {
+        HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+        if (!hProcess) return false;
+        wchar_t path[MAX_PATH];
+        bool ok = GetProcessImageFileNameW(hProcess, path, MAX_PATH) != 0;
+        CloseHandle(hProcess);
+        const wchar_t* filename = ok ? wcsrchr(path, L'\\') : nullptr;
+        if (!filename) return false;
+        image = filename + 1;
+        return true;
+    }
+    std::wstring WindowTitle(WindowId window) override {
+        wchar_t title[512];
+        return GetWindowTextW((HWND)window, title, 512) ? title : L"";
+    }
+    bool WatchProcess(std::uint32_t pid) override {
+        HANDLE hProcess = OpenProcess(SYNCHRONIZE, FALSE, pid);
+        if (!hProcess) return false;
+        HANDLE hWait = nullptr;
+        if (!RegisterWaitForSingleObject(&hWait, hProcess, OnProcessExit, (PVOID)(UINT_PTR)pid,
+                                         INFINITE, WT_EXECUTEONLYONCE)) {
+            CloseHandle(hProcess);
+            return false;
+        }
+        m_watches[pid] = {hProcess, hWait};
+        return true;
+    }
+    void UnwatchProcess(std::uint32_t pid) override {
+        auto it = m_watches.find(pid);
+        if (it == m_watches.end()) return;
+        UnregisterWaitEx(it->second.wait, INVALID_HANDLE_VALUE); // lets a running callback finish
+        CloseHandle(it->second.process);
+        m_watches.erase(it);
+    }
+
+private:
+    struct Watch { HANDLE process, wait; };
+    static void CALLBACK OnProcessExit(PVOID pid, BOOLEAN) {
+        if (g_hwndMain) PostMessage(g_hwndMain, WM_PROCESS_EXITED, (WPARAM)pid, 0);
+    }
+    std::unordered_map<std::uint32_t, Watch> m_watches; // UI thread only
+};
+Win32ForegroundProvider g_foregroundProvider;
+ContextTracker g_foreground(g_foregroundProvider, 64, TITLE_DEBOUNCE_MS); // UI thread only
+HWINEVENTHOOK g_hTitleEventHook = nullptr;
+
+// Publishes the tracker's current state. switchProfile: a new window came
+// to the front, so an app binding applies; title changes only refilter.
+void PublishForeground(bool switchProfile) {
+    const ForegroundState& fg = g_foreground.Current();
+    auto ctx = std::make_shared<AppContext>();
+    ctx->app = fg.app;
+    ctx->title = fg.title;
+    ctx->appUtf8 = WideToUtf8(fg.app);
+    ctx->titleUtf8 = WideToUtf8(fg.title);
+    ctx->appId = fg.appId;
+    ctx->titleId = fg.titleId;
+    g_context.store(ctx);
+
+    PostToWebView({ 
+        {"type", "app_changed"}, 
+        {"app", ctx->appUtf8},
+        {"title", ctx->titleUtf8}
+    });
+    
+    // Trigger profile switch if bound, else refilter the current one
+    auto bound = switchProfile ? g_appProfileBindings.find(ctx->app) : g_appProfileBindings.end();
+    if (bound != g_appProfileBindings.end()) {
+        SwitchProfile(bound->second);
+        SendLog("Auto-switched profile for: " + ctx->appUtf8);
+    } else {
+        RebuildContextView();
+    }
+}
+
 void CALLBACK WinEventProc(HWINEVENTHOOK hWinEventHook, DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD dwEventThread, DWORD dwmsEventTime);
 
 void StartAppMonitoring() {
@@ -876,6 +3695,12 @@ void StartAppMonitoring() {
             NULL, WinEventProc, 0, 0,
             WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
     }
+    if (!g_hTitleEventHook) {
+        g_hTitleEventHook = SetWinEventHook(
+            EVENT_OBJECT_NAMECHANGE, EVENT_OBJECT_NAMECHANGE,
+            NULL, WinEventProc, 0, 0,
+            WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+    }
 }
 
 void StopAppMonitoring() {
@@ -883,43 +3708,22 @@ void StopAppMonitoring() {
         UnhookWinEvent(g_hWinEventHook);
         g_hWinEventHook = nullptr;
     }
+    if (g_hTitleEventHook) {
+        UnhookWinEvent(g_hTitleEventHook);
+        g_hTitleEventHook = nullptr;
+    }
 }
 
 void CALLBACK WinEventProc(HWINEVENTHOOK hWinEventHook, DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD dwEventThread, DWORD dwmsEventTime) {
-    if (event == EVENT_SYSTEM_FOREGROUND && hwnd) {
-        wchar_t path[MAX_PATH];
-        DWORD pid;
-        GetWindowThreadProcessId(hwnd, &pid);
-        HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
-        if (hProcess) {
-            if (GetProcessImageFileNameW(hProcess, path, MAX_PATH)) {
-                wchar_t* filename = wcsrchr(path, L'\\');
-                if (filename) {
-                    g_currentApp = filename + 1;
-                    
-                    // Capture title too
-                    wchar_t title[512];
-                    if (GetWindowTextW(hwnd, title, 512)) {
-                        g_currentWindowTitle = title;
-                    } else {
-                        g_currentWindowTitle = L"";
-                    }
-
-                    PostToWebView({ 
-                        {"type", "app_changed"}, 
-                        {"app", WideToUtf8(g_currentApp)},
-                        {"title", WideToUtf8(g_currentWindowTitle)}
-                    });
-                    
-                    // Trigger profile switch if bound
-                    if (g_appProfileBindings.count(g_currentApp)) {
-                        LoadMappings(g_appProfileBindings[g_currentApp]);
-                        SendLog("Auto-switched profile for: " + WideToUtf8(g_currentApp));
-                    }
-                }
-            }
-            CloseHandle(hProcess);
-        }
+    if (!hwnd) return;
+    if (event == EVENT_SYSTEM_FOREGROUND) {
+        if (g_foreground.OnForeground((WindowId)hwnd)) PublishForeground(true);
+    }
+    else if (event == EVENT_OBJECT_NAMECHANGE && idObject == OBJID_WINDOW && idChild == CHILDID_SELF) {
+        // Every window's caption changes arrive here; the tracker drops all
+        // but the foreground one's and coalesces bursts
+        if (g_foreground.OnNameChange((WindowId)hwnd, GetTickCount64()))
+            SetTimer(g_hwndMain, TITLE_TIMER_ID, TITLE_DEBOUNCE_MS, NULL);
     }
 }
 
@@ -927,6 +3731,17 @@ void CALLBACK WinEventProc(HWINEVENTHOOK hWinEventHook, DWORD event, HWND hwnd,
 //  Handle messages from WebView2 (JS -> C++)
 // ══════════════════════════════════════════
 
+// msg[key] if it holds a T, else fallback. The page sends null for a field
+// it could not parse (NaN); that keeps the old value instead of throwing.
+template <class T>
+T MsgField(const json& msg, const char* key, const T& fallback) {
+    auto it = msg.find(key);
+    if (it == msg.end()) return fallback;
+    if constexpr (std::is_same_v<T, bool>) return it->is_boolean() ? it->template get<bool>() : fallback;
+    else if constexpr (std::is_same_v<T, int>) return it->is_number_integer() ? it->template get<int>() : fallback;
+    else return it->is_string() ? it->template get<std::string>() : fallback;
+}
+
 void HandleWebMessage(const std::string& messageStr) {
     json msg;
     try { msg = json::parse(messageStr); } catch (...) { return; }
@@ -951,26 +3766,28 @@ void HandleWebMessage(const std::string& messageStr) {
             }}
         };
         PostToWebView(cfgMsg);
-        // Auto-connect to last port
-        if (!g_lastConnectedPortName.empty()) {
-            for (int i = 0; i < (int)g_ports.size(); i++) {
-                if (g_ports[i] == g_lastConnectedPortName) {
-                    ConnectMidi(i);
-                    break;
-                }
-            }
+        // Auto-connect to the last used ports
+        SendDevicesToUI();
+        std::vector<std::string> lastPorts = g_lastConnectedPortNames;
+        for (const auto& name : lastPorts) {
+            auto it = std::find(g_ports.begin(), g_ports.end(), name);
+            if (it != g_ports.end()) ConnectMidi((int)(it - g_ports.begin()));
         }
         if (!g_lastProfilePath.empty()) {
             LoadMappings(g_lastProfilePath);
         }
+        if (!g_feedbackPortName.empty()) ConnectFeedback(g_feedbackPortName);
+    }
+    else if (action == "set_feedback_port") {
+        ConnectFeedback(msg.value("port", ""));
+        SaveConfig();
     }
     else if (action == "toggle_connect") {
-        if (!g_connected) {
-            int port = msg.value("port", 0);
-            ConnectMidi(port);
-        } else {
-            DisconnectMidi();
-        }
+        // Toggles the selected port; other open devices stay connected
+        int port = msg.value("port", 0);
+        int id = (port >= 0 && port < (int)g_ports.size()) ? FindOpenDevice(g_ports[port]) : -1;
+        if (id >= 0) DisconnectMidiDevice(id);
+        else ConnectMidi(port);
     }
     else if (action == "start_learn") {
         std::lock_guard<std::mutex> lock(g_learnMutex);
@@ -984,13 +3801,9 @@ void HandleWebMessage(const std::string& messageStr) {
             g_hKeyboardHook = NULL;
         }
 
-        // Kill any pending chord timers and clear the buffer
-        KillTimer(g_hwndMain, CHORD_TIMER_ID);
-        {
-            std::lock_guard<std::mutex> chordLock(g_chordMutex);
-            g_chordBuffer.clear();
-        }
+        DiscardChord();
 
+        RebuildMidiPrefilter();
         SendLog("Learning started: Waiting for MIDI...");
         SendStatus("Waiting for MIDI input...");
         PostToWebView({ {"type", "learn_phase"}, {"phase", 1}, {"text", "Waiting for MIDI..."} });
@@ -998,12 +3811,12 @@ void HandleWebMessage(const std::string& messageStr) {
     else if (action == "cancel_learn") {
         std::lock_guard<std::mutex> lock(g_learnMutex);
         g_learning = false;
-        KillTimer(g_hwndMain, CHORD_TIMER_ID);
         if (g_hKeyboardHook) {
             UnhookWindowsHookEx(g_hKeyboardHook);
             g_hKeyboardHook = NULL;
         }
         g_learn_pending = { -1, -1, {}, -1, 0, 1, 0, 0, -1, "", "", "", "", 0 };
+        RebuildMidiPrefilter();
         SendStatus("Learning cancelled.");
     }
     else if (action == "learn_key") {
@@ -1026,11 +3839,10 @@ void HandleWebMessage(const std::string& messageStr) {
             displayStr += (g_learn_pending.midi_type == 0 ? L"Note" : L"CC");
             displayStr += L" " + std::to_wstring(g_learn_pending.midi_num);
             displayStr += L" -> " + GetModifierString(g_learn_pending.modifiers) + GetKeyName(g_learn_pending.key_vk);
+            g_learning = false;
             SendLog(WideToUtf8(displayStr));
-            SendMappingsToUI();
+            OnMappingsChanged();
             SendStatus("Mapped successfully.");
-
-            g_learning = false;
             PostToWebView({ {"type", "learn_done"} });
         }
     }
@@ -1042,7 +3854,7 @@ void HandleWebMessage(const std::string& messageStr) {
                 g_mappings.erase(g_mappings.begin() + index);
             }
         }
-        SendMappingsToUI();
+        OnMappingsChanged();
         SendLog("Mapping removed.");
     }
     else if (action == "clear_mappings") {
@@ -1050,7 +3862,7 @@ void HandleWebMessage(const std::string& messageStr) {
             std::lock_guard<std::recursive_mutex> lock(g_mappingsMutex);
             g_mappings.clear();
         }
-        SendMappingsToUI();
+        OnMappingsChanged();
         SendLog("All mappings cleared.");
     }
     else if (action == "update_mapping") {
@@ -1059,24 +3871,45 @@ void HandleWebMessage(const std::string& messageStr) {
             std::lock_guard<std::recursive_mutex> lock(g_mappingsMutex);
             if (index < (int)g_mappings.size()) {
                 Mapping& m = g_mappings[index];
-                m.midi_type = msg.value("midi_type", m.midi_type);
-                m.key_vk = msg.value("key_vk", m.key_vk);
-                m.macro_text = msg.value("macro_text", m.macro_text);
-                m.ai_prompt = msg.value("ai_prompt", m.ai_prompt);
+                m.midi_type = MsgField(msg, "midi_type", m.midi_type);
+                m.midi_num = MsgField(msg, "midi_num", m.midi_num);
+                m.cc_action = MsgField(msg, "cc_action", m.cc_action);
+                m.key_vk = MsgField(msg, "key_vk", m.key_vk);
+                m.macro_text = MsgField(msg, "macro_text", m.macro_text);
+                m.ai_prompt = MsgField(msg, "ai_prompt", m.ai_prompt);
                 
                 if (msg.contains("midi_chord") && msg["midi_chord"].is_array()) {
-                    std::vector<int> chord = msg["midi_chord"].get<std::vector<int>>();
-                    std::sort(chord.begin(), chord.end());
-                    chord.erase(std::unique(chord.begin(), chord.end()), chord.end());
+                    std::vector<int> chord;
+                    for (const auto& n : msg["midi_chord"])
+                        if (n.is_number_integer()) chord.push_back(n.get<int>());
+                    chord.erase(std::remove_if(chord.begin(), chord.end(), [](int n) { return n < 0 || n > 127; }), chord.end());
+                    if (m.midi_type == 13) { // a sequence keeps its order and repeats
+                        if (chord.size() > SEQ_MAX_NOTES) chord.resize(SEQ_MAX_NOTES);
+                    } else {
+                        std::sort(chord.begin(), chord.end());
+                        chord.erase(std::unique(chord.begin(), chord.end()), chord.end());
+                    }
                     m.midi_chord = chord;
                 }
-
-                m.title_pattern = msg.value("title_pattern", m.title_pattern);
-                m.app_pattern = msg.value("app_pattern", m.app_pattern);
-                m.gesture_id = msg.value("gesture_id", m.gesture_id);
+                m.seq_window = MsgField(msg, "seq_window", m.seq_window);
+                m.chord_match = MsgField(msg, "chord_match", m.chord_match);
+
+                m.title_pattern = MsgField(msg, "title_pattern", m.title_pattern);
+                m.app_pattern = MsgField(msg, "app_pattern", m.app_pattern);
+                m.gesture_id = MsgField(msg, "gesture_id", m.gesture_id);
+                m.channel = MsgField(msg, "channel", m.channel);
+                m.device = MsgField(msg, "device", m.device);
+                m.cc_mode = MsgField(msg, "cc_mode", m.cc_mode);
+                m.cc14 = MsgField(msg, "cc14", m.cc14);
+                m.layers = MsgField(msg, "layers", m.layers);
+                m.layer_target = MsgField(msg, "layer_target", m.layer_target);
+                m.layer_mode = MsgField(msg, "layer_mode", m.layer_mode);
+                m.layer_cc = MsgField(msg, "layer_cc", m.layer_cc);
+                for (const auto& f : kMappingFields) // hold edits to what the loaders accept
+                    if (f.kind == MappingField::Int) m.*(f.number) = (int)std::clamp<long long>(m.*(f.number), f.min, f.max);
             }
         }
-        SendMappingsToUI();
+        OnMappingsChanged();
         SendLog("Mapping updated.");
     }
     else if (action == "save_profile") {
@@ -1084,7 +3917,7 @@ void HandleWebMessage(const std::string& messageStr) {
         wchar_t file[MAX_PATH] = L"mappings.json";
         ofn.lStructSize = sizeof(ofn);
         ofn.hwndOwner = g_hwndMain;
-        ofn.lpstrFilter = L"JSON Files\0*.json\0All Files\0*.*\0";
+        ofn.lpstrFilter = L"JSON Files\0*.json\0Compiled Profiles\0*.mtp\0All Files\0*.*\0";
         ofn.lpstrFile = file;
         ofn.nMaxFile = MAX_PATH;
         ofn.Flags = OFN_OVERWRITEPROMPT;
@@ -1092,6 +3925,8 @@ void HandleWebMessage(const std::string& messageStr) {
         if (GetSaveFileName(&ofn)) {
             SaveMappings(file);
             g_lastProfilePath = file;
+            g_mappingsDirty = false;
+            g_fileProfile = g_profile.load();
             SaveConfig();
             SendLog("Profile saved: " + WideToUtf8(file));
         }
@@ -1101,7 +3936,7 @@ void HandleWebMessage(const std::string& messageStr) {
         wchar_t file[MAX_PATH] = L"";
         ofn.lStructSize = sizeof(ofn);
         ofn.hwndOwner = g_hwndMain;
-        ofn.lpstrFilter = L"JSON Files\0*.json\0All Files\0*.*\0";
+        ofn.lpstrFilter = L"JSON Files\0*.json\0Compiled Profiles\0*.mtp\0All Files\0*.*\0";
         ofn.lpstrFile = file;
         ofn.nMaxFile = MAX_PATH;
         ofn.Flags = OFN_FILEMUSTEXIST;
@@ -1111,6 +3946,14 @@ void HandleWebMessage(const std::string& messageStr) {
             SendLog("Profile loaded: " + WideToUtf8(file));
         }
     }
+    else if (action == "get_persist_stats") {
+        PostToWebView({ {"type", "persist_stats"},
+                        {"queue_depth", g_persistDepth.load()},
+                        {"last_write_ms", g_persistLastMs.load()},
+                        {"max_write_ms", g_persistMaxMs.load()},
+                        {"writes", g_persistWrites.load()},
+                        {"failures", g_persistFailures.load()} });
+    }
     else if (action == "update_config") {
         g_autoReconnect = msg.value("auto_reconnect", true);
         g_appSwitchingEnabled = msg.value("app_switching", false);
@@ -1135,7 +3978,7 @@ void HandleWebMessage(const std::string& messageStr) {
             Mapping m = { 0, 0, {}, 0, 0, 1, 0, 0, -1, "", "", "", "", 0 };
             g_mappings.push_back(m);
         }
-        SendMappingsToUI();
+        OnMappingsChanged();
         SendLog("Manual mapping added.");
     }
     else if (action == "open_settings") {
@@ -1171,6 +4014,9 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
         if (g_appSwitchingEnabled) StartAppMonitoring();
         SetTimer(hwnd, RECONNECT_TIMER_ID, RECONNECT_INTERVAL, NULL);
         SetTimer(hwnd, PIANO_DECAY_TIMER, PIANO_DECAY_MS, NULL);
+        SetTimer(hwnd, FEEDBACK_TIMER_ID, FEEDBACK_INTERVAL_MS, NULL);
+        StartMidiEngine();
+        StartProfileWatch();
         AddTrayIcon(hwnd);
         break;
     case WM_SIZE:
@@ -1181,26 +4027,36 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
         }
         break;
     case WM_TIMER:
-        if (wParam >= GESTURE_TIMER_ID && wParam < GESTURE_TIMER_ID + 128) {
-            int note = (int)(wParam - GESTURE_TIMER_ID);
+        if (wParam >= GESTURE_TIMER_ID && wParam < GESTURE_TIMER_ID + NOTE_SLOTS) {
+            int slot = (int)(wParam - GESTURE_TIMER_ID);
             KillTimer(hwnd, wParam);
             
             int finalTapCount = 0;
             {
                 std::lock_guard<std::mutex> lock(g_gestureMutex);
-                auto& state = g_keyStates[note];
+                auto& state = g_keyStates[slot];
                 finalTapCount = state.tapCount;
                 state.tapCount = 0;
                 state.processingGesture = false;
             }
             
-            if (finalTapCount == 1) ResolveGesture(note, 0); // Single
-            else if (finalTapCount == 2) ResolveGesture(note, 1); // Double
+            if (finalTapCount == 1) ResolveGesture(slot, 0); // Single
+            else if (finalTapCount == 2) ResolveGesture(slot, 1); // Double
             return 0;
         }
         if (wParam == RECONNECT_TIMER_ID) {
             TryAutoReconnect();
         }
+        else if (wParam == FEEDBACK_TIMER_ID) {
+            FlushFeedback();
+        }
+        else if (wParam == TITLE_TIMER_ID) {
+            ULONGLONG now = GetTickCount64();
+            if (g_foreground.Poll(now)) PublishForeground(false);
+            ULONGLONG due = g_foreground.NextDue();
+            if (!due) KillTimer(hwnd, TITLE_TIMER_ID);
+            else SetTimer(hwnd, TITLE_TIMER_ID, (UINT)(due > now ? due - now : 1), NULL);
+        }
         else if (wParam == PIANO_DECAY_TIMER) {
             bool changed = false;
             for (int i = 0; i < PIANO_TOTAL_KEYS; i++) {
@@ -1216,24 +4072,14 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                 PostToWebView({ {"type", "piano_decay"}, {"velocities", vel} });
             }
         }
-        else if (wParam == CHORD_TIMER_ID) {
-            KillTimer(hwnd, CHORD_TIMER_ID);
-            std::vector<int> chord;
-            {
-                std::lock_guard<std::mutex> lock(g_chordMutex);
-                chord = g_chordBuffer;
-                g_chordBuffer.clear();
-            }
-            ProcessChord(chord);
-        }
-        break;
-    case WM_CHORD_SIGNAL:
-        if (!g_learning) {
-            KillTimer(hwnd, CHORD_TIMER_ID);
-            SetTimer(hwnd, CHORD_TIMER_ID, CHORD_THRESHOLD_MS, NULL);
-        }
         break;
 
+    case WM_PROFILE_RELOADED:
+        ApplyReloadedProfiles();
+        break;
+    case WM_PROCESS_EXITED:
+        g_foreground.ForgetProcess((std::uint32_t)wParam);
+        break;
     case WM_UI_BRIDGE_SIGNAL:
         while (true) {
             json msg;
@@ -1279,7 +4125,7 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
     case WM_USER + 100: {
         int slot = (int)wParam;
         if (slot >= 0 && slot < (int)g_profileSlots.size()) {
-            LoadMappings(g_profileSlots[slot]);
+            SwitchProfile(g_profileSlots[slot]);
             SendLog("Switched to profile slot #" + std::to_string(slot));
             SendStatus("Profile switched via MIDI.");
         }
@@ -1314,13 +4160,19 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
         return 0;
     case WM_DESTROY:
         if (g_hKeyboardHook) { UnhookWindowsHookEx(g_hKeyboardHook); g_hKeyboardHook = NULL; }
+        StopProfileWatch();
         SaveConfig();
+        StopPersistence();
         KillTimer(hwnd, RECONNECT_TIMER_ID);
         KillTimer(hwnd, PIANO_DECAY_TIMER);
-        KillTimer(hwnd, CHORD_TIMER_ID);
-        if (g_hWinEventHook) { UnhookWinEvent(g_hWinEventHook); g_hWinEventHook = nullptr; }
+        KillTimer(hwnd, FEEDBACK_TIMER_ID);
+        KillTimer(hwnd, TITLE_TIMER_ID);
+        StopAppMonitoring();
         RemoveTrayIcon();
-        g_midiIn.reset();
+        for (auto& dev : g_midiDevices) dev.in.reset();
+        StopMidiEngine();
+        g_midiOut.reset();
+        g_thruGraph.store(nullptr);
         g_webview = nullptr;
         g_controller = nullptr;
         PostQuitMessage(0);
@@ -1411,7 +4263,8 @@ void InitWebView2(HWND hwnd) {
                                         wil::unique_cotaskmem_string messageRaw;
                                         args->TryGetWebMessageAsString(&messageRaw);
                                         if (messageRaw) {
-                                            HandleWebMessage(WideToUtf8(messageRaw.get()));
+                                            try { HandleWebMessage(WideToUtf8(messageRaw.get())); }
+                                            catch (const json::exception& e) { SendLog(std::string("Ignored a malformed UI message: ") + e.what()); }
                                         }
                                         return S_OK;
                                     }).Get(), nullptr);
@@ -1431,6 +4284,17 @@ void InitWebView2(HWND hwnd) {
 // ══════════════════════════════════════════
 
 int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ PWSTR pCmdLine, _In_ int nCmdShow) {
+    // Headless profile conversion: MIDITypist.exe --convert <from> <to>
+    // (.json <-> .mtp, chosen by extension)
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (argv && argc == 4 && std::wstring(argv[1]) == L"--convert") {
+        bool ok = ConvertProfile(argv[2], argv[3]);
+        LocalFree(argv);
+        return ok ? 0 : 1;
+    }
+    if (argv) LocalFree(argv);
+
     SetProcessDpiAwarenessContext(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2);
 
     // Initialize COM for WebView2
@@ -1440,6 +4304,8 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
     g_hInst = hInstance;
     g_configPath = GetConfigDir() + L"midityper_config.json";
     LoadConfig();
+    PrecompileProfiles();
+    RebuildThruGraph();
 
     INITCOMMONCONTROLSEX icc = { sizeof(INITCOMMONCONTROLSEX), ICC_BAR_CLASSES };
     InitCommonControlsEx(&icc);
@@ -1517,7 +4383,7 @@ LRESULT CALLBACK LowLevelKeyboardProc(int nCode, WPARAM wParam, LPARAM lParam) {
                 displayStr += L" -> " + GetModifierString(g_learn_pending.modifiers) + GetKeyName(g_learn_pending.key_vk);
                 
                 SendLog(WideToUtf8(displayStr));
-                SendMappingsToUI();
+                OnMappingsChanged();
                 SendStatus("Mapped successfully.");
                 PostToWebView({ {"type", "learn_done"} });
                 
@@ -21,6 +21,7 @@ if (window.chrome?.webview) {
         const msg = e.data;
         switch (msg.type) {
             case 'mappings': updateMappings(msg.mappings); break;
+            case 'mappings_patch': patchMappings(msg.count, msg.changes); break;
             case 'midi_note': handleMidiEvent('Note', msg.note, msg.velocity); break;
             case 'midi_cc': handleMidiEvent('CC', msg.cc, msg.value); break;
             case 'status': setStatus(msg.text); break;
@@ -37,8 +38,9 @@ if (window.chrome?.webview) {
                 break;
             case 'log': addLog(msg.text, msg.category); break;
             case 'run_ai': handleAiRequest(msg.prompt); break;
-            case 'ports': updatePorts(msg.ports, msg.selected); break;
+            case 'ports': updatePorts(msg.ports, msg.selected, msg.outputs, msg.feedback_port); break;
             case 'config': syncConfig(msg.config); break;
+            case 'devices': updateDevices(msg.devices); break;
         }
     });
 }
@@ -66,6 +68,13 @@ function toggleTheme() {
     localStorage.setItem('miditypist-theme', theme);
 }
 
+// Profile reloaded from disk: only the changed entries are sent
+function patchMappings(count, changes) {
+    mappings.length = count;
+    changes.forEach(c => { mappings[c.index] = c.mapping; });
+    updateMappings(mappings);
+}
+
 function updateMappings(list) {
     mappings = list;
     const grid = document.getElementById('mapGrid');
@@ -82,9 +91,22 @@ function updateMappings(list) {
         else if (m.midi_type === 4) target = 'Macro';
         else if (m.midi_type === 5) target = 'AI';
         else if (m.midi_type === 2) target = 'Chord Key ' + m.key_vk;
+        else if (m.midi_type === 13) target = 'Sequence Key ' + m.key_vk;
+        else if (m.midi_type === 6) target = ['', 'Mouse X', 'Mouse Y', 'Scroll'][m.cc_action] || 'None';
+        else if (m.midi_type === 12) target = 'Key ' + m.key_vk;
+        else if (m.midi_type === 3) target = `Layer ${m.layer_target} ${['Hold', 'Toggle', 'One-shot'][m.layer_mode] || ''}`;
+        else if (m.midi_type >= 7 && m.midi_type <= 11) target = ['Key ' + m.key_vk, 'Mouse X', 'Mouse Y', 'Scroll', 'Hold'][m.cc_action] || 'None';
 
         let gesture = m.gesture_id === 1 ? 'DBL' : (m.gesture_id === 2 ? 'HLD' : 'TAP');
-        let titleLine = m.midi_type === 2 ? `Chord [${(m.midi_chord || []).join(',')}]` : `${m.midi_type === 1 ? 'CC' : 'Note'} ${m.midi_num}`;
+        let titleLine = m.midi_type === 2 ? `Chord [${(m.midi_chord || []).join(',')}]${['', ' any octave', ' any key'][m.chord_match || 0] || ''}` : `${m.midi_type === 1 || (m.midi_type === 3 && m.layer_cc) ? 'CC' : 'Note'} ${m.midi_num}`;
+        if (m.midi_type === 6) titleLine = 'MPE ' + (['Bend', 'Pressure', 'Timbre'][m.midi_num] || '?');
+        else if (m.midi_type === 13) titleLine = `Sequence ${(m.midi_chord || []).join(', ')} in ${m.seq_window ?? 500}ms`;
+        else if (m.midi_type === 7 || m.midi_type === 8) titleLine = `${m.midi_type === 7 ? 'NRPN' : 'RPN'} ${m.midi_num}`;
+        else if (m.midi_type === 9) titleLine = 'Pitch Bend';
+        else if (m.midi_type === 10) titleLine = 'Channel Pressure';
+        else if (m.midi_type === 11) titleLine = `Poly AT ${m.midi_num}`;
+        else if (m.midi_type === 12) titleLine = `Program ${m.midi_num}`;
+        else if (m.midi_type === 1 && m.cc14) titleLine = `CC ${m.midi_num}/${m.midi_num + 32}`;
 
         card.innerHTML = `
       <div style="display:flex; justify-content:space-between; align-items:flex-start;">
@@ -95,6 +117,7 @@ function updateMappings(list) {
       <div class="mapping-footer" style="display:flex; justify-content:space-between; align-items:center; margin-top:8px;">
         <div class="badge-row">
            ${m.app_pattern ? `<span class="context-pill">${m.app_pattern}</span>` : ''}
+           ${(m.layers ?? 1) !== 1 ? `<span class="context-pill">L${layerList(m.layers).join(',')}</span>` : ''}
         </div>
         <button class="btn" style="padding:4px; color:var(--error);" onclick="event.stopPropagation(); deleteMapping(${i})">
           <svg style="width:14px; height:14px;" viewBox="0 0 24 24" fill="none" stroke="currentColor" stroke-width="2"><polyline points="3 6 5 6 21 6"></polyline><path d="M19 6v14a2 2 0 0 1-2 2H7a2 2 0 0 1-2-2V6m3 0V4a2 2 0 0 1 2-2h4a2 2 0 0 1 2 2v2"></path></svg>
@@ -182,7 +205,7 @@ function setStatus(text) {
     if (btn) btn.textContent = text.includes('Connected') ? 'Disconnect' : 'Connect';
 }
 
-function updatePorts(ports, selectedIdx) {
+function updatePorts(ports, selectedIdx, outputs, feedbackPort) {
     const sel = document.getElementById('selectMidiPort');
     if (!sel) return;
     sel.innerHTML = '';
@@ -193,6 +216,26 @@ function updatePorts(ports, selectedIdx) {
         if (i === selectedIdx) opt.selected = true;
         sel.appendChild(opt);
     });
+
+    const fb = document.getElementById('selectFeedbackPort');
+    if (!fb) return;
+    fb.innerHTML = '';
+    const none = document.createElement('option');
+    none.value = '';
+    none.textContent = 'None';
+    fb.appendChild(none);
+    (outputs || []).forEach(p => {
+        const opt = document.createElement('option');
+        opt.value = p;
+        opt.textContent = p;
+        if (p === feedbackPort) opt.selected = true;
+        fb.appendChild(opt);
+    });
+}
+
+function setFeedbackPort() {
+    const fb = document.getElementById('selectFeedbackPort');
+    if (fb) send('set_feedback_port', { port: fb.value });
 }
 
 function syncConfig(cfg) {
@@ -214,6 +257,19 @@ function syncConfig(cfg) {
     }
 }
 
+// Layer bitmask <-> list of layer numbers
+function layerList(mask) {
+    const out = [];
+    for (let l = 0; l < 16; l++) if ((mask >> l) & 1) out.push(l);
+    return out;
+}
+
+function layerMask(text) {
+    const mask = text.split(',').map(s => parseInt(s.trim())).filter(n => n >= 0 && n < 16)
+        .reduce((acc, l) => acc | (1 << l), 0);
+    return mask || 1;
+}
+
 // --- Editor Functions ---
 let activeIdx = -1;
 function openEditor(i) {
@@ -226,9 +282,22 @@ function openEditor(i) {
     document.getElementById('editMidiType').value = m.midi_type;
     document.getElementById('editKeyVk').value = m.key_vk;
     document.getElementById('editGestureId').value = m.gesture_id || 0;
+    document.getElementById('editChannel').value = m.channel ?? -1;
+    document.getElementById('editDevice').value = m.device ?? -1;
     document.getElementById('editMacroText').value = m.macro_text || '';
     document.getElementById('editAiPrompt').value = m.ai_prompt || '';
     document.getElementById('editMidiChord').value = (m.midi_chord || []).join(', ');
+    document.getElementById('editChordMatch').value = m.chord_match || 0;
+    document.getElementById('editMidiSequence').value = (m.midi_chord || []).join(', ');
+    document.getElementById('editSeqWindow').value = m.seq_window ?? 500;
+    if (m.midi_type === 6) {
+        document.getElementById('editMpeDim').value = m.midi_num;
+        document.getElementById('editMpeAxis').value = m.cc_action || 1;
+    }
+    document.getElementById('editLayers').value = layerList(m.layers ?? 1).join(', ');
+    document.getElementById('editLayerTarget').value = m.layer_target ?? 1;
+    document.getElementById('editLayerMode').value = m.layer_mode || 0;
+    document.getElementById('editLayerCc').value = m.layer_cc ? 1 : 0;
     document.getElementById('editAppPattern').value = m.app_pattern || '';
     document.getElementById('editTitlePattern').value = m.title_pattern || '';
     toggleEditFields();
@@ -244,25 +313,52 @@ function toggleEditFields() {
     const fields = {
         'editFieldMacro': type == 4,
         'editFieldAi': type == 5,
-        'editFieldKey': (type != 4 && type != 5),
-        'editFieldChord': type == 2
+        'editFieldKey': (type != 3 && type != 4 && type != 5 && type != 6),
+        'editFieldChord': type == 2,
+        'editFieldSequence': type == 13,
+        'editFieldMpe': type == 6,
+        'editFieldLayer': type == 3
     };
 
     for (const [id, visible] of Object.entries(fields)) {
         const el = document.getElementById(id);
-        if (el) el.style.display = visible ? 'block' : 'none';
+        if (el) el.style.display = visible ? (id === 'editFieldMpe' || id === 'editFieldLayer' || id === 'editFieldSequence' || id === 'editFieldChord' ? 'grid' : 'block') : 'none';
     }
 }
 
 function saveEdit() {
-    const chordStr = document.getElementById('editMidiChord').value;
+    const picked = parseInt(document.getElementById('editMidiType').value);
+    const type = isNaN(picked) ? mappings[activeIdx].midi_type : picked; // no option for it: keep it
+    const chordStr = document.getElementById(type === 13 ? 'editMidiSequence' : 'editMidiChord').value;
     const chordArr = chordStr.split(',').map(s => parseInt(s.trim())).filter(n => !isNaN(n));
+    const chord = type === 2 ? {
+        chord_match: parseInt(document.getElementById('editChordMatch').value)
+    } : {};
+    const sequence = type === 13 ? {
+        seq_window: parseInt(document.getElementById('editSeqWindow').value) || 500
+    } : {};
+    const mpe = type === 6 ? {
+        midi_num: parseInt(document.getElementById('editMpeDim').value),
+        cc_action: parseInt(document.getElementById('editMpeAxis').value)
+    } : {};
+    const layerKey = type === 3 ? {
+        layer_target: parseInt(document.getElementById('editLayerTarget').value),
+        layer_mode: parseInt(document.getElementById('editLayerMode').value),
+        layer_cc: document.getElementById('editLayerCc').value === '1'
+    } : {};
 
     send('update_mapping', {
+        ...mpe,
+        ...layerKey,
+        ...chord,
+        ...sequence,
+        layers: layerMask(document.getElementById('editLayers').value),
         index: activeIdx,
-        midi_type: parseInt(document.getElementById('editMidiType').value),
+        midi_type: type,
         key_vk: parseInt(document.getElementById('editKeyVk').value),
         gesture_id: parseInt(document.getElementById('editGestureId').value),
+        channel: parseInt(document.getElementById('editChannel').value),
+        device: parseInt(document.getElementById('editDevice').value),
         macro_text: document.getElementById('editMacroText').value,
         ai_prompt: document.getElementById('editAiPrompt').value,
         midi_chord: chordArr,
@@ -272,6 +368,33 @@ function saveEdit() {
     closeEditor();
 }
 
+function updateDevices(devices) {
+    const sel = document.getElementById('editDevice');
+    if (!sel) return;
+    const current = sel.value;
+    sel.innerHTML = '<option value="-1">Any</option>';
+    (devices || []).forEach(d => {
+        const opt = document.createElement('option');
+        opt.value = d.id;
+        opt.textContent = d.connected ? d.name : `${d.name} (offline)`;
+        sel.appendChild(opt);
+    });
+    sel.value = current;
+    if (sel.selectedIndex < 0) sel.value = -1;
+}
+
+function initChannelSelect() {
+    const sel = document.getElementById('editChannel');
+    if (!sel) return;
+    sel.innerHTML = '<option value="-1">Any</option>';
+    for (let ch = 0; ch < 16; ch++) {
+        const opt = document.createElement('option');
+        opt.value = ch;
+        opt.textContent = `Ch ${ch + 1}`;
+        sel.appendChild(opt);
+    }
+}
+
 // --- Actions ---
 function startLearn() {
     learnPhase = 1;
@@ -364,5 +487,6 @@ document.addEventListener('DOMContentLoaded', () => {
     const savedTheme = localStorage.getItem('miditypist-theme');
     if (savedTheme) document.documentElement.setAttribute('data-theme', savedTheme);
     initPiano();
+    initChannelSelect();
     send('init');
 });
@@ -0,0 +1,63 @@
+// Checks that a loaded profile never pins its file: saving over a .mtp the
+// app has just read must succeed, as it does when the user saves the active
+// profile or a converter rewrites a cached one. Windows only.
+//   cl /std:c++20 /EHsc /I..\src FileIOTest.cpp
+#include "FileIO.h"
+
+#include <cstdio>
+
+static int g_failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); g_failures++; } \
+    } while (0)
+
+static std::wstring TempPath(const wchar_t* name) {
+    wchar_t dir[MAX_PATH];
+    GetTempPathW(MAX_PATH, dir);
+    return std::wstring(dir) + name;
+}
+
+static void TestSaveOverLoaded() {
+    std::wstring path = TempPath(L"miditypist_fileio_test.mtp");
+    std::string first(4096, '\x11'), second(8192, '\x22');
+    CHECK(WriteFileAtomic(path, first));
+
+    std::string loaded;
+    CHECK(ReadFileBytes(path, loaded));
+    CHECK(loaded == first);
+
+    // The loaded bytes stay alive, like a profile still in use
+    CHECK(WriteFileAtomic(path, second));
+    std::string reread;
+    CHECK(ReadFileBytes(path, reread));
+    CHECK(reread == second);
+    CHECK(loaded == first);
+
+    CHECK(WriteFileAtomic(path, first)); // and again, over the reloaded one
+    CHECK(GetFileAttributesW((path + L".tmp").c_str()) == INVALID_FILE_ATTRIBUTES);
+    DeleteFileW(path.c_str());
+}
+
+static void TestReadEdges() {
+    std::string bytes = "untouched";
+    CHECK(!ReadFileBytes(TempPath(L"miditypist_fileio_missing.mtp"), bytes));
+
+    std::wstring path = TempPath(L"miditypist_fileio_empty.mtp");
+    CHECK(WriteFileAtomic(path, std::string()));
+    CHECK(ReadFileBytes(path, bytes));
+    CHECK(bytes.empty());
+    DeleteFileW(path.c_str());
+}
+
+int main() {
+    TestSaveOverLoaded();
+    TestReadEdges();
+    if (g_failures) {
+        std::printf("%d check(s) failed\n", g_failures);
+        return 1;
+    }
+    std::printf("All FileIO checks passed\n");
+    return 0;
+}
@@ -0,0 +1,135 @@
+// Headless checks for ContextTracker: image caching, process exits and title
+// debouncing, driven by ScriptedForegroundProvider.
+//   g++ -std=c++20 -I../src ForegroundContextTest.cpp -o ForegroundContextTest
+#include "ForegroundContext.h"
+
+#include <cstdio>
+
+static int g_failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); g_failures++; } \
+    } while (0)
+
+static void TestCaching() {
+    ScriptedForegroundProvider p;
+    p.processes = {{1, 100}, {2, 200}, {3, 100}};
+    p.images = {{100, L"a.exe"}, {200, L"b.exe"}};
+    ContextTracker t(p, 64, 150);
+
+    CHECK(t.OnForeground(1));
+    CHECK(t.Current().app == L"a.exe");
+    CHECK(t.OnForeground(2));
+    CHECK(t.OnForeground(1));
+    CHECK(p.imageCalls == 2);              // each process opened once
+    CHECK(t.CacheHits() == 1 && t.CacheMisses() == 2);
+
+    CHECK(!t.OnForeground(1));             // focus bounced back, nothing read
+    CHECK(p.imageCalls == 2);
+    int appId = t.Current().appId;
+    t.OnForeground(3);                     // another window of the same process
+    CHECK(t.Current().appId == appId);
+    CHECK(p.imageCalls == 2);
+}
+
+static void TestEviction() {
+    ScriptedForegroundProvider p;
+    p.processes = {{1, 100}, {2, 200}, {3, 300}};
+    p.images = {{100, L"a.exe"}, {200, L"b.exe"}, {300, L"c.exe"}};
+    ContextTracker t(p, 2, 150);
+
+    t.OnForeground(1);
+    t.OnForeground(2);
+    t.OnForeground(3);                     // evicts a.exe, the least recently used
+    t.OnForeground(2);
+    CHECK(p.imageCalls == 3);
+    t.OnForeground(1);
+    CHECK(p.imageCalls == 4);
+    CHECK(p.watched == std::set<std::uint32_t>({100, 200})); // evicted processes are released
+}
+
+static void TestPidReuse() {
+    ScriptedForegroundProvider p;
+    p.processes = {{1, 100}, {2, 200}};
+    p.images = {{100, L"a.exe"}, {200, L"b.exe"}};
+    ContextTracker t(p, 64, 150);
+
+    t.OnForeground(1);
+    t.OnForeground(2);
+    CHECK(p.watched.count(100) && p.watched.count(200));
+    t.ForgetProcess(100);                  // the provider saw it exit
+    CHECK(!p.watched.count(100));
+    p.images[100] = L"c.exe";              // pid 100 now belongs to a new process
+    CHECK(t.OnForeground(1));
+    CHECK(t.Current().app == L"c.exe");
+    CHECK(p.imageCalls == 3);
+
+    t.OnForeground(2);
+    t.OnForeground(1);
+    CHECK(p.imageCalls == 3);              // hits only
+}
+
+static void TestUnwatchable() {
+    ScriptedForegroundProvider p;
+    p.processes = {{1, 100}, {2, 200}};
+    p.images = {{100, L"a.exe"}, {200, L"b.exe"}};
+    p.unwatchable = {100};
+    {
+        ContextTracker t(p, 64, 150);
+        t.OnForeground(1);
+        t.OnForeground(2);
+        t.OnForeground(1);
+        CHECK(t.Current().app == L"a.exe");
+        CHECK(p.imageCalls == 3);          // never cached, so read on every switch
+        CHECK(t.CacheHits() == 0);
+        CHECK(p.watched == std::set<std::uint32_t>({200}));
+    }
+    CHECK(p.watched.empty());              // the tracker releases what it holds
+}
+
+static void TestTitleDebounce() {
+    ScriptedForegroundProvider p;
+    p.processes = {{1, 100}, {2, 100}};
+    p.images = {{100, L"a.exe"}};
+    p.titles = {{1, L"one"}};
+    ContextTracker t(p, 64, 150);
+
+    t.OnForeground(1);
+    int calls = p.titleCalls;
+    CHECK(!t.OnNameChange(2, 0));          // not the foreground window
+    CHECK(t.OnNameChange(1, 1000));        // opens the window
+    CHECK(t.NextDue() == 1150);
+    p.titles[1] = L"two";
+    CHECK(!t.OnNameChange(1, 1050));       // already pending
+    CHECK(!t.Poll(1100));
+    CHECK(p.titleCalls == calls);          // nothing read before it is due
+    CHECK(t.Poll(1150));
+    CHECK(t.Current().title == L"two");
+    CHECK(p.titleCalls == calls + 1);
+    CHECK(t.NextDue() == 0);
+
+    CHECK(t.OnNameChange(1, 2000));
+    CHECK(!t.Poll(2150));                  // title read back unchanged
+    CHECK(t.Current().title == L"two");
+
+    CHECK(t.OnNameChange(1, 3000));
+    p.titles[2] = L"other";
+    t.OnForeground(2);                     // a switch drops the pending change
+    CHECK(t.NextDue() == 0);
+    CHECK(t.Current().title == L"other");
+}
+
+int main() {
+    TestCaching();
+    TestEviction();
+    TestPidReuse();
+    TestUnwatchable();
+    TestTitleDebounce();
+    if (g_failures) {
+        std::printf("%d check(s) failed\n", g_failures);
+        return 1;
+    }
+    std::printf("All ContextTracker checks passed\n");
+    return 0;
+}
@@ -0,0 +1,197 @@
+// Drives X11ForegroundSource against a real X server: the test plays the
+// window manager on a second connection, setting _NET_ACTIVE_WINDOW and
+// window titles, and checks what reaches the ContextTracker. Needs $DISPLAY.
+//   g++ -std=c++20 -I../src X11ForegroundTest.cpp -lX11 -o X11ForegroundTest
+//   xvfb-run -a ./X11ForegroundTest
+#include "X11ForegroundSource.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+
+static int g_failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); g_failures++; } \
+    } while (0)
+
+static std::uint64_t NowMs() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Runs the event loop until the tracker publishes a change or timeoutMs passes
+static bool Pump(X11ForegroundSource& x11, ContextTracker& t, int timeoutMs) {
+    std::uint64_t deadline = NowMs() + timeoutMs;
+    for (;;) {
+        std::uint64_t now = NowMs();
+        bool changed = t.Poll(now);
+        changed |= x11.Dispatch(t, now);
+        if (changed) return true;
+        if (now >= deadline) return false;
+        std::uint64_t wake = t.NextDue() ? std::min(t.NextDue(), deadline) : deadline;
+        pollfd pfd = {x11.EventFd(), POLLIN, 0};
+        poll(&pfd, 1, (int)(wake > now ? wake - now : 0));
+    }
+}
+
+// The window manager's side
+struct FakeWm {
+    Display* display = nullptr;
+    Window root = None;
+    Atom active, name, pid, utf8;
+
+    bool Open() {
+        display = XOpenDisplay(nullptr);
+        if (!display) return false;
+        root = DefaultRootWindow(display);
+        active = XInternAtom(display, "_NET_ACTIVE_WINDOW", False);
+        name = XInternAtom(display, "_NET_WM_NAME", False);
+        pid = XInternAtom(display, "_NET_WM_PID", False);
+        utf8 = XInternAtom(display, "UTF8_STRING", False);
+        return true;
+    }
+    Window Create(pid_t owner, const char* title) {
+        Window w = XCreateSimpleWindow(display, root, 0, 0, 10, 10, 0, 0, 0);
+        long p = owner;
+        XChangeProperty(display, w, pid, XA_CARDINAL, 32, PropModeReplace, (unsigned char*)&p, 1);
+        SetTitle(w, title);
+        return w;
+    }
+    void SetTitle(Window w, const char* title) {
+        XChangeProperty(display, w, name, utf8, 8, PropModeReplace, (const unsigned char*)title,
+                        (int)std::strlen(title));
+        XSync(display, False);
+    }
+    void Activate(Window w) {
+        long id = (long)w;
+        XChangeProperty(display, root, active, XA_WINDOW, 32, PropModeReplace, (unsigned char*)&id, 1);
+        XSync(display, False);
+    }
+};
+
+static std::wstring ImageOf(pid_t pid) {
+    char path[PATH_MAX];
+    std::string link = "/proc/" + std::to_string(pid) + "/exe";
+    ssize_t n = readlink(link.c_str(), path, sizeof(path) - 1);
+    std::string full(path, n > 0 ? (size_t)n : 0);
+    std::string base = full.substr(full.find_last_of('/') + 1);
+    return std::wstring(base.begin(), base.end());
+}
+
+// Starts `sleep` and returns once it has exec'd, so /proc/<pid>/exe is sleep's
+static pid_t SpawnSleep() {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) return -1;
+    pid_t child = fork();
+    if (child == 0) {
+        execlp("sleep", "sleep", "30", (char*)nullptr);
+        _exit(127);
+    }
+    close(fds[1]);
+    char c;
+    while (read(fds[0], &c, 1) > 0) {} // EOF once exec closes the write end
+    close(fds[0]);
+    return child;
+}
+
+static int g_foreignErrors = 0;
+static int CountingHandler(Display*, XErrorEvent*) {
+    g_foreignErrors++;
+    return 0;
+}
+
+static void TestSwitchingAndTitles(FakeWm& wm) {
+    Window self = wm.Create(getpid(), "alpha");
+    wm.Activate(self);
+
+    pid_t child = SpawnSleep();
+    CHECK(child > 0);
+    Window other = wm.Create(child, "beta");
+
+    XSetErrorHandler(CountingHandler);
+    {
+        X11ForegroundSource x11;
+        CHECK(x11.Open());
+        ContextTracker t(x11, 64, 150);
+
+        // The window active before Open is reported first
+        CHECK(Pump(x11, t, 2000));
+        CHECK(t.Current().window == (WindowId)self);
+        CHECK(t.Current().app == ImageOf(getpid()));
+        CHECK(t.Current().title == L"alpha");
+
+        wm.Activate(other);
+        CHECK(Pump(x11, t, 2000));
+        CHECK(t.Current().app == L"sleep");
+        CHECK(t.Current().title == L"beta");
+
+        // A burst of title changes is published once, after the debounce
+        wm.SetTitle(other, "gamma");
+        wm.SetTitle(other, "delta");
+        CHECK(Pump(x11, t, 2000));
+        CHECK(t.Current().title == L"delta");
+        CHECK(!Pump(x11, t, 300));
+
+        // Titles of background windows are ignored
+        wm.SetTitle(self, "ignored");
+        CHECK(!Pump(x11, t, 300));
+
+        wm.Activate(self);
+        CHECK(Pump(x11, t, 2000));
+        CHECK(t.CacheHits() == 1 && t.CacheMisses() == 2);
+        wm.Activate(other);
+        CHECK(Pump(x11, t, 2000));
+        CHECK(t.CacheHits() == 2 && t.CacheMisses() == 2);
+
+        // The exit reaches the tracker, so the dead pid is looked up afresh
+        // (and fails) instead of being served from the cache
+        kill(child, SIGKILL);
+        waitpid(child, nullptr, 0);
+        wm.Activate(self);
+        CHECK(Pump(x11, t, 2000));
+        wm.Activate(other);
+        CHECK(!Pump(x11, t, 300));
+        CHECK(t.Current().window == (WindowId)self);
+        CHECK(t.CacheHits() == 3 && t.CacheMisses() == 3);
+
+        // A window destroyed before it is queried raises BadWindow on the
+        // source's connection: swallowed, not fatal, not forwarded
+        Window gone = wm.Create(getpid(), "gone");
+        XSync(wm.display, False);
+        XDestroyWindow(wm.display, gone);
+        wm.Activate(gone);
+        CHECK(!Pump(x11, t, 300));
+        CHECK(t.Current().window == (WindowId)self);
+        CHECK(g_foreignErrors == 0);
+
+        // Errors on other connections still reach the previous handler
+        char* unused = nullptr;
+        XFetchName(wm.display, gone, &unused);
+        XSync(wm.display, False);
+        CHECK(g_foreignErrors == 1);
+    }
+    CHECK(XSetErrorHandler(nullptr) == CountingHandler); // restored on close
+}
+
+int main() {
+    FakeWm wm;
+    if (!wm.Open()) {
+        std::printf("No X server; run under xvfb-run\n");
+        return 1;
+    }
+    TestSwitchingAndTitles(wm);
+    XCloseDisplay(wm.display);
+    if (g_failures) {
+        std::printf("%d check(s) failed\n", g_failures);
+        return 1;
+    }
+    std::printf("All X11 foreground checks passed\n");
+    return 0;
+}